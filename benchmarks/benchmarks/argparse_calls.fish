@@ -0,0 +1,11 @@
+# Call a function which starts with argparse, like many shipped functions do.
+function argparse_user
+    argparse -n argparse_user -x a,b -N 1 h/help a/all b/brief 'c/count=' 'e/exclude=+' \
+        'w/width=!_validate_int' v/verbose -- $argv
+    or return
+end
+
+for i in (seq 20000)
+    argparse_user --all -c 3 -e x -e y --verbose some args
+    argparse_user -b file
+end
@@ -0,0 +1,4 @@
+# Asking about many names that are not functions, as highlighting and completion do.
+for i in (seq 100000)
+    functions -q __bench_no_such_function_$i
+end
@@ -0,0 +1,7 @@
+# Tight loops of cheap builtins, where dispatch overhead dominates.
+for i in (seq 100000)
+    set -l x $i
+    test $x -gt 0
+    string length -q -- $x
+    true
+end
@@ -0,0 +1,9 @@
+# Many small command substitutions, the way prompts and completions use them.
+function __bench_value
+    echo value $argv
+end
+for i in (seq 20000)
+    set -l a (echo $i)
+    set -l b (__bench_value $i)
+    set -l c "prefix-(string upper -- x$i)-suffix"
+end
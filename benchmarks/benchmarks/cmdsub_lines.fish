@@ -0,0 +1,4 @@
+# Splice a large command substitution into a variable.
+for i in (seq 3)
+    set -l x (seq 1000000)
+end
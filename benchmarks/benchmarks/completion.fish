@@ -0,0 +1,12 @@
+# Completing commands, options, variables and paths.
+set -l dir (mktemp -d)
+or exit 1
+touch $dir/file(seq 500)
+for i in (seq 30)
+    complete -C 'string re' >/dev/null
+    complete -C 'set -g fish_' >/dev/null
+    complete -C 'echo $PA' >/dev/null
+    complete -C "ls $dir/file1" >/dev/null
+    complete -C 'fish --' >/dev/null
+end
+rm -r $dir
@@ -0,0 +1,9 @@
+# Membership tests against long lists held in variables.
+set -l haystack (seq 2000)
+set -l needles (seq 1000 5 4000)
+for i in (seq 5)
+    for x in $needles
+        contains -- $x $haystack
+        string match -q -- $x $haystack
+    end
+end
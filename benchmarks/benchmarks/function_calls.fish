@@ -0,0 +1,16 @@
+# Calls to small functions, with and without arguments and local variables.
+function __bench_noop
+end
+function __bench_args
+    set -l first $argv[1]
+    set -l rest $argv[2..-1]
+    return 0
+end
+function __bench_nested
+    __bench_args $argv
+end
+for i in (seq 30000)
+    __bench_noop
+    __bench_args $i a b c
+    __bench_nested $i
+end
@@ -0,0 +1,13 @@
+# Wildcard expansion over a scratch tree with many entries.
+set -l dir (mktemp -d)
+or exit 1
+for d in (seq 20)
+    mkdir $dir/dir$d
+    touch $dir/dir$d/file(seq 100).txt $dir/dir$d/other(seq 50).log
+end
+for i in (seq 20)
+    count $dir/*/*.txt >/dev/null
+    count $dir/dir1*/file?5.txt >/dev/null
+    count $dir/**.log >/dev/null
+end
+rm -r $dir
@@ -0,0 +1,15 @@
+# Searches through a large history file.
+set -q XDG_DATA_HOME
+or set -l XDG_DATA_HOME ~/.local/share
+set -l file $XDG_DATA_HOME/fish/__fish_bench_history
+mkdir -p $XDG_DATA_HOME/fish
+for i in (seq 20000)
+    printf -- '- cmd: git commit -m "change %s"\n  when: %s\n' $i (math 1600000000 + $i)
+end >$file
+set -g fish_history __fish_bench
+for i in (seq 10)
+    history search --contains 'change 1999' >/dev/null
+    history search --prefix 'git commit -m "change 5' --max 50 >/dev/null
+    history search --exact 'git commit -m "change 12345"' >/dev/null
+end
+rm $file
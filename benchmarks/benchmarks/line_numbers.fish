@@ -0,0 +1,10 @@
+# Every block records the line it starts on. Here each iteration jumps back over a long loop body.
+begin
+    echo 'for i in (seq 5000)'
+    echo '    begin; end'
+    for i in (seq 2000)
+        echo '    # Some text to make the lines longer.'
+    end
+    echo '    begin; end'
+    echo end
+end | source
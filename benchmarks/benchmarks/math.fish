@@ -0,0 +1,6 @@
+set -l total 0
+for i in (seq 50000)
+    set total (math $total + $i % 7)
+end
+
+seq 200000 | math --batch '{} * 2 + 1' >/dev/null
@@ -0,0 +1,7 @@
+set -l names (seq 100000 | string replace -r '^' name)
+set -l nums (seq 100000)
+
+for i in (seq 5)
+    printf '%s\t%d\n' $names $nums >/dev/null
+    printf '%-12s|%6.2f|%x\n' $names $nums $nums >/dev/null
+end
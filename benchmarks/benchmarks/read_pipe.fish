@@ -0,0 +1,4 @@
+# Read lines one at a time from a pipe.
+seq 100000 | while read -l line
+    set -l x $line
+end
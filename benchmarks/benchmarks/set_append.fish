@@ -0,0 +1,11 @@
+# Growing lists one element at a time, locally and globally.
+set -l list
+for i in (seq 3000)
+    set -a list $i
+end
+set -g __bench_list
+for i in (seq 3000)
+    set -ga __bench_list $i
+    set -p list x
+end
+count $list $__bench_list >/dev/null
@@ -0,0 +1,6 @@
+# Setting and erasing variables nobody watches.
+for i in (seq 100000)
+    set -l x $i
+    set -g __bench_global $i
+    set -e __bench_global
+end
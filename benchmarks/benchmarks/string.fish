@@ -0,0 +1,14 @@
+set -l lines (seq 20000 | string replace -r '$' ' foo bar baz')
+
+for line in $lines
+    string match -qr '^(\d+) foo' -- $line
+end
+
+for line in $lines
+    string replace -r 'b(a[rz])' 'q$1' -- $line >/dev/null
+end
+
+for i in (seq 20)
+    printf '%s\n' $lines | string match -r '^\d*7\d* (\w+)' >/dev/null
+    printf '%s\n' $lines | string replace -ar '\s+' _ >/dev/null
+end
@@ -0,0 +1,10 @@
+# Regex matching and replacement with captures, one argument at a time and in bulk.
+set -l paths /usr/lib/lib(seq 5000).so.(seq 3)
+for i in (seq 10)
+    for p in $paths[1..5000]
+        string match -qr '^/usr/(\w+)/lib(\d+)\.so\.(\d)$' -- $p
+    end
+    string replace -r '^/usr/(\w+)/lib(\d+)\.so\.(\d)$' '$2:$3' -- $paths >/dev/null
+    string match -ar 'lib(\d*[05])\.so' -- $paths >/dev/null
+    string split -m1 -r . -- $paths >/dev/null
+end
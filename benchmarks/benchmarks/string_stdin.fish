@@ -0,0 +1,5 @@
+# Pipe a large amount of data through string subcommands that read stdin.
+for i in (seq 5)
+    seq 500000 | string match -r 7 | string length >/dev/null
+    seq 500000 | string replace -r '^' 'line ' | string split ' ' >/dev/null
+end
@@ -0,0 +1,5 @@
+# Numeric and string tests in a loop, the way loop conditions use them.
+for i in (seq 200000)
+    test $i -lt 100000
+    [ $i -gt 0 -a $i != x ]
+end
@@ -0,0 +1,7 @@
+# Tokenize every script in share/, which is the first step of parsing and highlighting.
+set -l files (status dirname)/../../share/**.fish
+for i in (seq 5)
+    for file in $files
+        read -z -t -a tokens <$file
+    end
+end
@@ -0,0 +1,11 @@
+# Setting variables while variable and generic event handlers are defined.
+for i in (seq 50)
+    function __bench_watch_$i --on-variable __bench_var_$i
+    end
+end
+function __bench_handler --on-variable __bench_watched
+end
+for i in (seq 50000)
+    set -g __bench_unwatched $i
+    set -g __bench_watched $i
+end
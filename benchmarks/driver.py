@@ -0,0 +1,325 @@
+#!/usr/bin/env python3
+
+""" Benchmark driver.
+
+Runs the scripts in benchmarks/benchmarks with a fish binary, repeatedly, and reports wall, user
+and system time, peak memory and the number of processes fish started for each one. Results can
+be written as JSON and compared against another binary or an earlier result file.
+
+    driver.py run [-n RUNS] [-o results.json] /path/to/fish [benchmark ...]
+    driver.py compare [-n RUNS] [-t PERCENT] BASELINE NEW [benchmark ...]
+
+For compare, BASELINE and NEW are each either a fish binary or a JSON file written by run. Two
+binaries are run alternately so that noise on the machine affects both alike. The exit status is 1
+if any benchmark regressed.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import re
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCHMARKS_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "benchmarks")
+
+# The metrics measured on every run, in the order they are printed.
+METRICS = ("wall", "user", "sys", "maxrss_kb")
+
+# How fish reports each process it starts, with -d exec-fork.
+FORK_RE = re.compile(r"exec-fork: Fork #\d+")
+
+
+class Environment(object):
+    """ A scratch home for the benchmarked shell, so that the user's configuration, universal
+    variables and history neither slow down nor get touched by the benchmarks. """
+
+    def __init__(self):
+        self.root = tempfile.mkdtemp(prefix="fish_bench.")
+        self.env = dict(os.environ)
+        for var, sub in (
+            ("HOME", "home"),
+            ("XDG_CONFIG_HOME", "config"),
+            ("XDG_DATA_HOME", "data"),
+            ("XDG_CACHE_HOME", "cache"),
+            ("XDG_RUNTIME_DIR", "runtime"),
+        ):
+            path = os.path.join(self.root, sub)
+            os.mkdir(path, 0o700)
+            self.env[var] = path
+        self.env.pop("fish_history", None)
+
+    def cleanup(self):
+        shutil.rmtree(self.root, ignore_errors=True)
+
+
+def list_benchmarks(names):
+    """ Return (name, path) for each requested benchmark, or all of them. """
+    available = sorted(
+        f[: -len(".fish")] for f in os.listdir(BENCHMARKS_DIR) if f.endswith(".fish")
+    )
+    if not names:
+        names = available
+    result = []
+    for name in names:
+        name = os.path.basename(name)
+        if name.endswith(".fish"):
+            name = name[: -len(".fish")]
+        if name not in available:
+            sys.exit("Unknown benchmark: %s" % name)
+        result.append((name, os.path.join(BENCHMARKS_DIR, name + ".fish")))
+    return result
+
+
+def run_once(fish, script, environment):
+    """ Run a benchmark once, returning its metrics and exit status. """
+    start = time.perf_counter()
+    proc = subprocess.Popen(
+        [fish, script],
+        stdin=subprocess.DEVNULL,
+        stdout=subprocess.DEVNULL,
+        cwd=environment.root,
+        env=environment.env,
+    )
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.perf_counter() - start
+    # Tell the subprocess module it has been reaped, so it does not try again.
+    if os.WIFSIGNALED(status):
+        proc.returncode = -os.WTERMSIG(status)
+    else:
+        proc.returncode = os.WEXITSTATUS(status)
+    maxrss = usage.ru_maxrss
+    if sys.platform == "darwin":
+        # Macs report bytes, everyone else kilobytes.
+        maxrss //= 1024
+    sample = {"wall": wall, "user": usage.ru_utime, "sys": usage.ru_stime, "maxrss_kb": maxrss}
+    return sample, proc.returncode
+
+
+def count_forks(fish, script, environment):
+    """ Count the processes fish starts for a benchmark, through its exec-fork debug output.
+    This is a separate run, since the debug output costs time of its own. """
+    log = os.path.join(environment.root, "forks.log")
+    subprocess.call(
+        [fish, "-d", "exec-fork", "-o", log, script],
+        stdin=subprocess.DEVNULL,
+        stdout=subprocess.DEVNULL,
+        stderr=subprocess.DEVNULL,
+        cwd=environment.root,
+        env=environment.env,
+    )
+    try:
+        with open(log, errors="replace") as f:
+            return sum(1 for line in f if FORK_RE.search(line))
+    except IOError:
+        return None
+    finally:
+        if os.path.exists(log):
+            os.unlink(log)
+
+
+def summarize(samples):
+    """ Statistics over the samples of one metric. """
+    ordered = sorted(samples)
+    return {
+        "min": ordered[0],
+        "median": statistics.median(ordered),
+        "mean": statistics.mean(ordered),
+        "stdev": statistics.stdev(ordered) if len(ordered) > 1 else 0.0,
+        "max": ordered[-1],
+        "samples": samples,
+    }
+
+
+def fish_version(fish):
+    try:
+        out = subprocess.check_output([fish, "--version"], stderr=subprocess.STDOUT)
+        return out.decode("utf-8", "replace").strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def run_benchmarks(fishes, benchmarks, runs, warmup, progress):
+    """ Run each benchmark with each fish binary and return one result document per binary.
+    The binaries take turns on each run. """
+    environment = Environment()
+    docs = [
+        {"fish": fish, "version": fish_version(fish), "runs": runs, "warmup": warmup,
+         "benchmarks": []}
+        for fish in fishes
+    ]
+    try:
+        for name, script in benchmarks:
+            if progress:
+                print(name, end="", file=sys.stderr)
+                sys.stderr.flush()
+            samples = [dict((m, []) for m in METRICS) for _ in fishes]
+            statuses = [0 for _ in fishes]
+            for i in range(warmup + runs):
+                for which, fish in enumerate(fishes):
+                    sample, status = run_once(fish, script, environment)
+                    statuses[which] = statuses[which] or status
+                    if i < warmup:
+                        continue
+                    for metric in METRICS:
+                        samples[which][metric].append(sample[metric])
+                if progress:
+                    print(".", end="", file=sys.stderr)
+                    sys.stderr.flush()
+            if progress:
+                print(file=sys.stderr)
+            for which, fish in enumerate(fishes):
+                result = {"name": name, "status": statuses[which]}
+                for metric in METRICS:
+                    result[metric] = summarize(samples[which][metric])
+                result["forks"] = count_forks(fish, script, environment)
+                docs[which]["benchmarks"].append(result)
+    finally:
+        environment.cleanup()
+    return docs
+
+
+def print_results(doc):
+    print("%s (%s), %d runs" % (doc["fish"], doc["version"], doc["runs"]))
+    print(
+        "%-20s %10s %10s %10s %10s %10s %7s"
+        % ("benchmark", "wall", "+/-", "user", "sys", "maxrss kb", "forks")
+    )
+    for result in doc["benchmarks"]:
+        forks = result["forks"]
+        print(
+            "%-20s %9.3fs %9.3fs %9.3fs %9.3fs %10d %7s%s"
+            % (
+                result["name"],
+                result["wall"]["median"],
+                result["wall"]["stdev"],
+                result["user"]["median"],
+                result["sys"]["median"],
+                result["maxrss_kb"]["max"],
+                "?" if forks is None else forks,
+                "" if result["status"] == 0 else "  (exit status %d)" % result["status"],
+            )
+        )
+
+
+def compare_results(base, new, threshold):
+    """ Print how each benchmark changed from base to new, and return the names of those that
+    regressed. A slowdown only counts if the median grew by more than the threshold and even the
+    fastest new run is slower than the typical baseline run, so that noise does not count. More
+    forks count regardless, as fork counts are exact. """
+    base_by_name = dict((r["name"], r) for r in base["benchmarks"])
+    regressions = []
+    print("baseline: %s (%s)" % (base["fish"], base["version"]))
+    print("new:      %s (%s)" % (new["fish"], new["version"]))
+    print(
+        "%-20s %10s %10s %8s %12s %11s  %s"
+        % ("benchmark", "baseline", "new", "change", "maxrss kb", "forks", "verdict")
+    )
+    for result in new["benchmarks"]:
+        old = base_by_name.get(result["name"])
+        if old is None:
+            continue
+        old_wall, new_wall = old["wall"], result["wall"]
+        change = (new_wall["median"] - old_wall["median"]) / old_wall["median"] * 100
+        verdict = ""
+        if change > threshold and new_wall["min"] > old_wall["median"]:
+            verdict = "REGRESSION"
+        elif change < -threshold and new_wall["max"] < old_wall["median"]:
+            verdict = "improvement"
+        old_forks, new_forks = old.get("forks"), result.get("forks")
+        if old_forks is not None and new_forks is not None and new_forks > old_forks:
+            verdict = "REGRESSION"
+        if result["status"] != old["status"]:
+            verdict = "exit status %d -> %d" % (old["status"], result["status"])
+        if verdict.startswith("REGRESSION") or verdict.startswith("exit"):
+            regressions.append(result["name"])
+        print(
+            "%-20s %9.3fs %9.3fs %+7.1f%% %5d->%-6d %4s->%-6s %s"
+            % (
+                result["name"],
+                old_wall["median"],
+                new_wall["median"],
+                change,
+                old["maxrss_kb"]["max"],
+                result["maxrss_kb"]["max"],
+                "?" if old_forks is None else old_forks,
+                "?" if new_forks is None else new_forks,
+                verdict,
+            )
+        )
+    return regressions
+
+
+def load_results(what, benchmarks):
+    """ Load a result file, keeping only the given benchmarks, or return None for a binary. """
+    if not what.endswith(".json"):
+        return None
+    with open(what) as f:
+        doc = json.load(f)
+    names = set(name for name, _ in benchmarks)
+    doc["benchmarks"] = [r for r in doc["benchmarks"] if r["name"] in names]
+    return doc
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run fish's benchmarks", formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog=__doc__
+    )
+    sub = parser.add_subparsers(dest="command")
+    run = sub.add_parser("run", help="run the benchmarks with one fish")
+    run.add_argument("fish", help="the fish binary to benchmark")
+    compare = sub.add_parser("compare", help="compare two fish binaries or result files")
+    compare.add_argument("baseline", help="fish binary or JSON results to compare against")
+    compare.add_argument("new", help="fish binary or JSON results to check")
+    compare.add_argument(
+        "-t", "--threshold", type=float, default=5.0,
+        help="percentage slowdown that counts as a regression (default 5)",
+    )
+    for p in (run, compare):
+        p.add_argument("-n", "--runs", type=int, default=5, help="measured runs (default 5)")
+        p.add_argument("-w", "--warmup", type=int, default=1, help="warmup runs (default 1)")
+        p.add_argument("-o", "--output", help="write the results as JSON to this file")
+        p.add_argument("-q", "--quiet", action="store_true", help="do not show progress")
+        p.add_argument("benchmarks", nargs="*", help="benchmarks to run (default all)")
+    args = parser.parse_args()
+    if not args.command:
+        parser.print_help()
+        return 2
+    if args.runs < 1 or args.warmup < 0:
+        parser.error("need at least one run and no negative warmup")
+
+    benchmarks = list_benchmarks(args.benchmarks)
+    progress = not args.quiet and sys.stderr.isatty()
+
+    if args.command == "run":
+        doc = run_benchmarks([args.fish], benchmarks, args.runs, args.warmup, progress)[0]
+        if args.output:
+            with open(args.output, "w") as f:
+                json.dump(doc, f, indent=2)
+        print_results(doc)
+        return 0
+
+    docs = [load_results(what, benchmarks) for what in (args.baseline, args.new)]
+    to_run = [what for what, doc in zip((args.baseline, args.new), docs) if doc is None]
+    if to_run:
+        ran = iter(run_benchmarks(to_run, benchmarks, args.runs, args.warmup, progress))
+        docs = [doc if doc is not None else next(ran) for doc in docs]
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump({"baseline": docs[0], "new": docs[1]}, f, indent=2)
+    regressions = compare_results(docs[0], docs[1], args.threshold)
+    if regressions:
+        print("Regressed: %s" % " ".join(regressions))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+
+""" Interactive latency benchmark.
+
+Runs an interactive fish on a pseudo-terminal and replays key sequences to it: typing with
+autosuggestions from a large history, searching that history, completing with a pager full of
+candidates and running commands under a slow prompt. For every key it measures two times:
+
+    echo     from writing the key to the first byte fish writes back
+    settle   from writing the key to the last byte of the repaint, i.e. until fish has been quiet
+             for the quiet period, so this includes asynchronous highlighting and autosuggestions
+
+and reports percentiles of each per scenario.
+
+    interactive_latency.py [-n REPS] [--quiet-ms MS] [-o results.json] /path/to/fish [scenario ...]
+"""
+
+from __future__ import print_function
+
+import argparse
+import fcntl
+import json
+import os
+import pty
+import select
+import shutil
+import signal
+import struct
+import sys
+import tempfile
+import termios
+import time
+
+ROWS, COLUMNS = 40, 120
+
+CTRL_C = "\x03"
+UP = "\x1b[A"
+TAB = "\t"
+# Go to the end of the line and kill back to its start, leaving an empty command line.
+CLEAR_LINE = "\x05\x15"
+
+CONFIG = r"""
+set -g fish_greeting
+set -g fish_autosuggestion_enabled 1
+
+# A prompt which does about as much work as the popular ones, including running a command.
+function fish_prompt
+    set -l parts (string split / -- $PWD)
+    for i in (seq 30)
+        set -l segment (string sub -l 3 -- $parts[-1])(string repeat -n 2 -)
+    end
+    printf '%s@%s %s%s%s [%s]> ' $USER (prompt_hostname) (set_color green) (prompt_pwd) \
+        (set_color normal) (command date +%H:%M:%S)
+end
+function fish_right_prompt
+    printf '%s' (set_color brblack) (count $history) (set_color normal)
+end
+
+# A command with thousands of candidates with descriptions.
+function benchcmd
+end
+complete -c benchcmd -f -a '(seq 3000 | string replace -r "(.*)" "item$1\tdescription $1")'
+"""
+
+
+def make_history(path, count):
+    """ Write a history with commands which share prefixes, as real histories do. """
+    with open(path, "w") as f:
+        for i in range(count):
+            f.write('- cmd: git commit -m "change %d" -- src/file%d.cpp\n' % (i, i % 97))
+            f.write("  when: %d\n" % (1600000000 + i))
+            if i % 3 == 0:
+                f.write("- cmd: make -C build/dir%d test\n  when: %d\n" % (i % 50, 1600000000 + i))
+
+
+def scenarios(reps):
+    """ Return (name, steps) pairs. Each step is (keys, measured): keys which are measured are
+    sent one key at a time, the others all at once and only waited for. """
+    typing = []
+    for i in range(reps):
+        typing.append(("git commit -m \"change %d\"" % (i * 7), True))
+        typing.append((CLEAR_LINE, False))
+
+    history = []
+    for _ in range(reps):
+        history.append(("git com", False))
+        history.append(([UP] * 5, True))
+        history.append((CLEAR_LINE, False))
+        history.append(("make -C build", False))
+        history.append(([UP] * 5, True))
+        history.append((CLEAR_LINE, False))
+
+    complete = []
+    for _ in range(reps):
+        complete.append(("benchcmd item1", False))
+        complete.append(([TAB], True))
+        complete.append((CTRL_C, False))
+
+    execute = []
+    for _ in range(reps):
+        execute.append(("true", False))
+        execute.append((["\r"], True))
+
+    return [
+        ("typing", typing),
+        ("history_search", history),
+        ("complete", complete),
+        ("execute", execute),
+    ]
+
+
+class Terminal(object):
+    """ fish running on a pseudo-terminal. """
+
+    def __init__(self, fish, env, cwd):
+        pid, fd = pty.fork()
+        if pid == 0:
+            try:
+                os.chdir(cwd)
+                os.execve(fish, [fish, "-i"], env)
+            finally:
+                os._exit(127)
+        self.pid, self.fd = pid, fd
+        fcntl.ioctl(fd, termios.TIOCSWINSZ, struct.pack("HHHH", ROWS, COLUMNS, 0, 0))
+        self.output = bytearray()
+
+    def read_until_quiet(self, quiet, first_timeout):
+        """ Read output until there has been none for quiet seconds. Return the times of the
+        first and last bytes read, which are None if fish wrote nothing within first_timeout. """
+        first = last = None
+        deadline = time.perf_counter() + first_timeout
+        while True:
+            now = time.perf_counter()
+            timeout = (deadline - now) if first is None else (last + quiet - now)
+            if timeout <= 0:
+                break
+            ready, _, _ = select.select([self.fd], [], [], timeout)
+            if not ready:
+                continue
+            try:
+                data = os.read(self.fd, 65536)
+            except OSError:
+                data = b""
+            if not data:
+                tail = self.output[-2000:].decode("utf-8", "replace")
+                raise RuntimeError("fish exited, its last output was:\n" + tail)
+            last = time.perf_counter()
+            if first is None:
+                first = last
+            self.output += data
+            del self.output[:-4096]
+        return first, last
+
+    def send(self, keys):
+        os.write(self.fd, keys.encode("utf-8"))
+
+    def close(self):
+        try:
+            os.kill(self.pid, signal.SIGHUP)
+            os.waitpid(self.pid, 0)
+        except OSError:
+            pass
+        os.close(self.fd)
+
+
+def percentile(ordered, p):
+    return ordered[int(round(p / 100.0 * (len(ordered) - 1)))]
+
+
+def summarize(samples):
+    ordered = sorted(samples)
+    result = {"count": len(ordered)}
+    if ordered:
+        for p in (50, 90, 99):
+            result["p%d" % p] = percentile(ordered, p)
+        result["max"] = ordered[-1]
+    return result
+
+
+def run_scenario(term, steps, quiet):
+    """ Replay a scenario, returning the echo and settle latencies of its measured keys. """
+    echo, settle = [], []
+    for keys, measured in steps:
+        if not measured:
+            term.send(keys)
+            term.read_until_quiet(quiet, quiet)
+            continue
+        # Typed text is sent a character at a time; key lists hold escape sequences whole.
+        for key in keys:
+            sent = time.perf_counter()
+            term.send(key)
+            first, last = term.read_until_quiet(quiet, 10)
+            if first is None:
+                continue
+            echo.append(first - sent)
+            settle.append(last - sent)
+    return echo, settle
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure keystroke latency of interactive fish",
+        formatter_class=argparse.RawDescriptionHelpFormatter, epilog=__doc__,
+    )
+    parser.add_argument("fish", help="the fish binary to measure")
+    parser.add_argument("scenarios", nargs="*", help="scenarios to run (default all)")
+    parser.add_argument("-n", "--reps", type=int, default=10, help="repetitions (default 10)")
+    parser.add_argument(
+        "--quiet-ms", type=float, default=50,
+        help="how long fish must be quiet for a repaint to count as finished (default 50)",
+    )
+    parser.add_argument("--history", type=int, default=50000, help="history items (default 50000)")
+    parser.add_argument("-o", "--output", help="write the results as JSON to this file")
+    args = parser.parse_args()
+
+    if not os.access(args.fish, os.X_OK):
+        parser.error("cannot run %s" % args.fish)
+    all_scenarios = scenarios(args.reps)
+    names = [name for name, _ in all_scenarios]
+    for name in args.scenarios:
+        if name not in names:
+            parser.error("unknown scenario %s, choose from %s" % (name, ", ".join(names)))
+    quiet = args.quiet_ms / 1000.0
+
+    root = tempfile.mkdtemp(prefix="fish_latency.")
+    env = dict(os.environ, TERM="xterm-256color")
+    for var in ("HOME", "XDG_CONFIG_HOME", "XDG_DATA_HOME", "XDG_CACHE_HOME"):
+        env[var] = os.path.join(root, var.lower())
+        os.makedirs(os.path.join(env[var], "fish"))
+    env.pop("fish_history", None)
+    with open(os.path.join(env["XDG_CONFIG_HOME"], "fish", "config.fish"), "w") as f:
+        f.write(CONFIG)
+    make_history(os.path.join(env["XDG_DATA_HOME"], "fish", "fish_history"), args.history)
+
+    results = {"fish": args.fish, "quiet_ms": args.quiet_ms, "history": args.history,
+               "scenarios": {}}
+    term = Terminal(os.path.abspath(args.fish), env, env["HOME"])
+    try:
+        if term.read_until_quiet(quiet * 4, 30)[0] is None:
+            sys.exit("fish did not draw a prompt")
+        print("%-16s %8s %10s %10s %10s %10s %10s" % (
+            "scenario", "keys", "echo p50", "echo p99", "settle p50", "settle p90", "settle p99"))
+        for name, steps in all_scenarios:
+            if args.scenarios and name not in args.scenarios:
+                continue
+            echo, settle = run_scenario(term, steps, quiet)
+            results["scenarios"][name] = {"echo": summarize(echo), "settle": summarize(settle)}
+            e, s = results["scenarios"][name]["echo"], results["scenarios"][name]["settle"]
+            if not echo:
+                print("%-16s %8d  (no output)" % (name, 0))
+                continue
+            print("%-16s %8d %8.2fms %8.2fms %8.2fms %8.2fms %8.2fms" % (
+                name, e["count"], e["p50"] * 1e3, e["p99"] * 1e3,
+                s["p50"] * 1e3, s["p90"] * 1e3, s["p99"] * 1e3))
+            sys.stdout.flush()
+    finally:
+        term.close()
+        shutil.rmtree(root, ignore_errors=True)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -4,3 +4,22 @@ add_custom_target(benchmark
     COMMAND ${CMAKE_SOURCE_DIR}/benchmarks/driver.sh $<TARGET_FILE:fish>
     USES_TERMINAL
 )
+
+# Define fish_bench, the microbenchmarks for the core routines.
+add_executable(fish_bench EXCLUDE_FROM_ALL
+               src/fish_bench.cpp)
+fish_link_deps_and_sign(fish_bench)
+
+add_custom_target(microbenchmark
+    COMMAND ./fish_bench
+    WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+    DEPENDS fish_bench
+    USES_TERMINAL
+)
+
+# Keystroke latency of interactive fish, measured through a pseudo-terminal.
+add_custom_target(interactive_benchmark
+    COMMAND ${CMAKE_SOURCE_DIR}/benchmarks/interactive_latency.py $<TARGET_FILE:fish>
+    DEPENDS fish
+    USES_TERMINAL
+)
@@ -95,6 +95,8 @@ if(NOT HAVE_TERM_H)
 endif()
 check_include_file_cxx(siginfo.h HAVE_SIGINFO_H)
 check_include_file_cxx(spawn.h HAVE_SPAWN_H)
+# tee() is Linux-specific; read uses it to look at pipe contents without consuming them.
+check_cxx_symbol_exists(tee fcntl.h HAVE_TEE)
 check_struct_has_member("struct stat" st_ctime_nsec "sys/stat.h" HAVE_STRUCT_STAT_ST_CTIME_NSEC
     LANGUAGE CXX)
 check_struct_has_member("struct stat" st_mtimespec.tv_nsec "sys/stat.h"
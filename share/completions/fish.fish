@@ -6,6 +6,8 @@ complete -c fish -s n -l no-execute -d "Only parse input, do not execute"
 complete -c fish -s i -l interactive -d "Run in interactive mode"
 complete -c fish -s l -l login -d "Run as a login shell"
 complete -c fish -s p -l profile -d "Output profiling information to specified file" -r
+complete -c fish -l profile-sample -d "Output sampled stacks in folded format to specified file" -r
+complete -c fish -l profile-sample-report -d "Output a sampled time report to specified file" -r
 complete -c fish -s d -l debug -d "Specify debug categories" -x -a "0\t'Warnings silenced'
 1\t'Default'
 2\t'Basic debug output'
@@ -13,6 +15,7 @@ complete -c fish -s d -l debug -d "Specify debug categories" -x -a "0\t'Warnings
 4\t'Much more debug output'
 5\t'Too much debug output'
 (fish --print-debug-categories | string replace ' ' \t)"
+complete -c fish -l debug-format -d "Format of debug output" -x -a "text json"
 complete -c fish -s D -l debug-stack-frames -d "Show specified # of frames with debug output" -x -a "(seq 128)\t\n"
 complete -c fish -s P -l private -d "Do not persist history"
 
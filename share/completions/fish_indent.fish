@@ -7,3 +7,5 @@ complete -c fish_indent -s w -l write -d 'Write to file'
 complete -c fish_indent -s d -l debug-level -x -d 'Enable debug at specified verbosity level'
 complete -c fish_indent -s D -l debug-stack-frames -x -d 'Specify how many stack frames to display in debug messages'
 complete -c fish_indent -l dump-parse-tree -d 'Dump information about parsed statements to stderr'
+complete -c fish_indent -s c -l check -d 'Only check whether the code is already indented'
+complete -c fish_indent -s j -l jobs -x -d 'Format this many files at the same time'
@@ -1,2 +1,3 @@
 complete -f -c math -r
 complete -f -c math -s s -l scale -r -x
+complete -f -c math -s b -l batch -d "Evaluate for every line of stdin"
@@ -2,7 +2,9 @@
 
 #include "ast.h"
 
+#include <algorithm>
 #include <array>
+#include <cwchar>
 
 #include "common.h"
 #include "flog.h"
@@ -23,9 +25,42 @@ static tok_flags_t tokenizer_flags_from_parse_flags(parse_tree_flags_t flags) {
     return tok_flags;
 }
 
+// Keywords are found through a perfect hash table, like builtins. If the static_assert fires after
+// adding a keyword, try other seeds until one works.
+static constexpr uint32_t kKeywordHashSeed = 22;
+static constexpr unsigned kKeywordHashBits = 6;
+static_assert(names_hash_perfectly(keyword_enum_map, keyword_enum_map_len - 1,
+                                   &enum_map<parse_keyword_t>::str, kKeywordHashSeed,
+                                   kKeywordHashBits),
+              "keywords collide in the hash table");
+
+namespace {
+struct keyword_hash_table_t {
+    const enum_map<parse_keyword_t> *slots[1 << kKeywordHashBits]{};
+    // No keyword is longer than this, so longer names don't need hashing.
+    size_t max_name_length{0};
+
+    keyword_hash_table_t() {
+        // Skip the sentinel.
+        for (size_t i = 0; i + 1 < keyword_enum_map_len; i++) {
+            const enum_map<parse_keyword_t> &entry = keyword_enum_map[i];
+            slots[name_hash_slot(entry.str, kKeywordHashSeed, kKeywordHashBits)] = &entry;
+            max_name_length = std::max(max_name_length, std::wcslen(entry.str));
+        }
+    }
+};
+}  // namespace
+
 // Given an expanded string, returns any keyword it matches.
 static parse_keyword_t keyword_with_name(const wchar_t *name) {
-    return str_to_enum(name, keyword_enum_map, keyword_enum_map_len);
+    static const keyword_hash_table_t table;
+    for (size_t len = 0; name[len] != L'\0'; len++) {
+        if (len >= table.max_name_length) return parse_keyword_t::none;
+    }
+    const enum_map<parse_keyword_t> *found =
+        table.slots[name_hash_slot(name, kKeywordHashSeed, kKeywordHashBits)];
+    if (found && std::wcscmp(found->str, name) == 0) return found->val;
+    return parse_keyword_t::none;
 }
 
 static bool is_keyword_char(wchar_t c) {
@@ -3,13 +3,26 @@
 
 #include "autoload.h"
 
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
 #include <chrono>
+#include <cwchar>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 #include "common.h"
 #include "env.h"
 #include "exec.h"
-#include "lru.h"
+#include "flog.h"
+#include "iothread.h"
+#include "parse_tree.h"
+#include "parse_util.h"
 #include "parser.h"
+#include "perf_counters.h"
+#include "wcstringutil.h"
 #include "wutil.h"  // IWYU pragma: keep
 
 /// The time before we'll recheck an autoloaded file.
@@ -33,10 +46,29 @@ class autoload_file_cache_t {
     /// The directories from which to load.
     const wcstring_list_t dirs_{};
 
-    /// Our LRU cache of checks that were misses.
-    /// The key is the command, the  value is the time of the check.
-    struct misses_lru_cache_t : public lru_cache_t<misses_lru_cache_t, timestamp_t> {};
-    misses_lru_cache_t misses_cache_;
+    /// The .fish files in one of our directories, as of when it was last listed.
+    struct dir_listing_t {
+        /// The directory's file id when it was listed. Adding or removing a file changes the
+        /// directory's modification time, and so its id.
+        file_id_t dir_id{kInvalidFileID};
+
+        /// Whether the directory could be listed. If not, files in it are looked for one by one.
+        bool listed{false};
+
+        /// Whether the directory was modified shortly before it was listed. A file added in the
+        /// same tick of a coarse modification time leaves the id unchanged, so such a listing is
+        /// redone until its modification time is safely in the past, like git's "racily clean"
+        /// index entries.
+        bool racy{false};
+
+        /// The names of the .fish files, without the suffix.
+        std::unordered_set<wcstring> names;
+    };
+
+    /// A listing for each of our directories, and when they were last checked against the
+    /// directories on disk. These are populated on first use.
+    std::vector<dir_listing_t> listings_;
+    maybe_t<timestamp_t> listings_checked_;
 
     /// The set of files that we have returned to the caller, along with the time of the check.
     /// The key is the command (not the path).
@@ -66,18 +98,67 @@ class autoload_file_cache_t {
     /// \return the directories.
     const wcstring_list_t &dirs() const { return dirs_; }
 
+    /// List any of our directories which have changed since they were last listed.
+    void update_listings();
+
+    /// \return the names of all files that may be autoloaded, as of the last update.
+    std::unordered_set<wcstring> listed_names() const;
+
     /// Check if a command \p cmd can be loaded.
     /// If \p allow_stale is true, allow stale entries; otherwise discard them.
     /// This returns an autoloadable file, or none() if there is no such file.
     maybe_t<autoloadable_file_t> check(const wcstring &cmd, bool allow_stale = false);
 };
 
+void autoload_file_cache_t::update_listings() {
+    listings_.resize(dirs_.size());
+    for (size_t i = 0; i < dirs_.size(); i++) {
+        dir_listing_t &listing = listings_.at(i);
+        // Get the id before listing, so that a file added while we list changes it again.
+        file_id_t dir_id = file_id_for_path(dirs_.at(i));
+        if (listings_checked_ && dir_id == listing.dir_id && !listing.racy) continue;
+
+        listing.dir_id = dir_id;
+        listing.listed = false;
+        listing.racy = false;
+        listing.names.clear();
+        if (dir_id == kInvalidFileID) continue;
+        listing.racy = dir_id.mod_seconds + kAutoloadStalenessInterval > time(nullptr);
+        dir_t dir(dirs_.at(i));
+        if (!dir.valid()) continue;
+
+        wcstring name;
+        while (dir.read(name)) {
+            if (string_suffixes_string(L".fish", name)) {
+                name.resize(name.size() - std::wcslen(L".fish"));
+                listing.names.insert(std::move(name));
+            }
+        }
+        listing.listed = true;
+    }
+    listings_checked_ = current_timestamp();
+}
+
+std::unordered_set<wcstring> autoload_file_cache_t::listed_names() const {
+    std::unordered_set<wcstring> result;
+    for (const dir_listing_t &listing : listings_) {
+        result.insert(listing.names.begin(), listing.names.end());
+    }
+    return result;
+}
+
 maybe_t<autoloadable_file_t> autoload_file_cache_t::locate_file(const wcstring &cmd) const {
+    assert(listings_.size() == dirs_.size() && "Listings should have been updated");
     // Re-use the storage for path.
     wcstring path;
-    for (const wcstring &dir : dirs()) {
+    for (size_t i = 0; i < dirs_.size(); i++) {
+        // Skip directories that do not exist, or that we know do not have the file.
+        const dir_listing_t &listing = listings_.at(i);
+        if (listing.dir_id == kInvalidFileID) continue;
+        if (listing.listed && !listing.names.count(cmd)) continue;
+
         // Construct the path as dir/cmd.fish
-        path = dir;
+        path = dirs_.at(i);
         path += L"/";
         path += cmd;
         path += L".fish";
@@ -111,26 +192,17 @@ maybe_t<autoloadable_file_t> autoload_file_cache_t::check(const wcstring &cmd, b
         known_files_.erase(iter);
     }
 
-    // Check misses.
-    if (timestamp_t *miss = misses_cache_.get(cmd)) {
-        if (allow_stale || is_fresh(*miss, current_timestamp())) {
-            // Re-use this cached miss.
-            return none();
-        }
-        // The miss is stale, remove it.
-        misses_cache_.evict_node(cmd);
+    // Misses are answered by the directory listings, which only touch the disk when they are
+    // stale, and then only to check the directories themselves.
+    if (!listings_checked_ ||
+        !(allow_stale || is_fresh(*listings_checked_, current_timestamp()))) {
+        update_listings();
     }
-
-    // We couldn't satisfy this request from the cache. Hit the disk.
     maybe_t<autoloadable_file_t> file = locate_file(cmd);
     if (file.has_value()) {
         auto ins = known_files_.emplace(cmd, known_file_t{*file, current_timestamp()});
         assert(ins.second && "Known files cache should not have contained this cmd");
         (void)ins;
-    } else {
-        bool ins = misses_cache_.insert(cmd, current_timestamp());
-        assert(ins && "Misses cache should not have contained this cmd");
-        (void)ins;
     }
     return file;
 }
@@ -161,6 +233,19 @@ wcstring_list_t autoload_t::get_autoloaded_commands() const {
     return result;
 }
 
+wcstring_list_t autoload_t::get_autoloadable_commands(const environment_t &env) {
+    wcstring_list_t paths;
+    if (maybe_t<env_var_t> mvar = env.get(env_var_name_)) paths = mvar->as_list();
+    if (paths != cache_->dirs()) {
+        cache_ = make_unique<autoload_file_cache_t>(std::move(paths));
+    }
+    cache_->update_listings();
+    std::unordered_set<wcstring> names = cache_->listed_names();
+    wcstring_list_t result(names.begin(), names.end());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
 maybe_t<wcstring> autoload_t::resolve_command(const wcstring &cmd, const environment_t &env) {
     if (maybe_t<env_var_t> mvar = env.get(env_var_name_)) {
         return resolve_command(cmd, mvar->as_list());
@@ -197,7 +282,141 @@ maybe_t<wcstring> autoload_t::resolve_command(const wcstring &cmd, const wcstrin
     return std::move(mfile->path);
 }
 
+static void preload_record(const wcstring &path);
+
 void autoload_t::perform_autoload(const wcstring &path, parser_t &parser) {
+    perf_timer_t timer(perf_counter_t::autoload);
+    preload_record(path);
     wcstring script_source = L"source " + escape_string(path, ESCAPE_ALL);
     exec_subshell(script_source, parser, false /* do not apply exit status */);
 }
+
+namespace {
+/// A file named in the preload manifest, read and parsed ahead of being sourced.
+struct preloaded_file_t {
+    /// The id of the file when it was read, to check that it has not changed since.
+    file_id_t file_id;
+    parsed_source_ref_t source;
+};
+
+/// The files autoloaded early in this session, to be written to the preload manifest.
+/// This is only accessed on the main thread.
+struct preload_recording_t {
+    bool active{false};
+    wcstring manifest_path;
+    std::chrono::steady_clock::time_point deadline;
+    wcstring_list_t paths;
+    std::unordered_set<wcstring> seen;
+};
+}  // namespace
+
+/// The preloaded files, by path.
+static owning_lock<std::unordered_map<wcstring, preloaded_file_t>> s_preloaded_files;
+
+static preload_recording_t s_preload_recording;
+
+/// Read all of \p fd into \p contents. \return false on error.
+static bool read_fd_contents(int fd, std::string *contents) {
+    char buff[4096];
+    for (;;) {
+        ssize_t amt = read_loop(fd, buff, sizeof buff);
+        if (amt < 0) return false;
+        if (amt == 0) return true;
+        contents->append(buff, amt);
+    }
+}
+
+/// Read and parse the script at \p path, and keep it for when it is sourced. Files which cannot be
+/// read or have syntax errors are skipped, so that sourcing them reports the problem as usual.
+static void preload_file(const wcstring &path) {
+    autoclose_fd_t fd{wopen_cloexec(path, O_RDONLY)};
+    if (!fd.valid()) return;
+    file_id_t file_id = file_id_for_fd(fd.fd());
+    std::string contents;
+    if (file_id == kInvalidFileID || !read_fd_contents(fd.fd(), &contents)) return;
+    fd.close();
+
+    // This matches how the reader parses a script file.
+    wcstring src = str2wcstring(contents);
+    if (!src.empty() && src.at(0) == UTF8_BOM_WCHAR) src.erase(0, 1);
+    parse_error_list_t errors;
+    auto ast = ast::ast_t::parse(src, parse_flag_none, &errors);
+    if (ast.errored() || parse_util_detect_errors(ast, src, &errors)) return;
+    auto ps = std::make_shared<parsed_source_t>(std::move(src), std::move(ast));
+    s_preloaded_files.acquire()->emplace(path, preloaded_file_t{file_id, std::move(ps)});
+}
+
+void autoload_preload_start(const wcstring &manifest_path, int record_seconds) {
+    ASSERT_IS_MAIN_THREAD();
+    autoclose_fd_t fd{wopen_cloexec(manifest_path, O_RDONLY)};
+    std::string contents;
+    if (fd.valid() && read_fd_contents(fd.fd(), &contents)) {
+        wcstring_list_t paths = split_string(str2wcstring(contents), L'\n');
+        FLOGF(autoload, L"Preloading files from '%ls'", manifest_path.c_str());
+        for (wcstring &path : paths) {
+            if (path.empty()) continue;
+            iothread_perform([path] { preload_file(path); });
+        }
+    }
+
+    preload_recording_t &rec = s_preload_recording;
+    rec.active = record_seconds > 0;
+    rec.manifest_path = manifest_path;
+    rec.deadline = std::chrono::steady_clock::now() + std::chrono::seconds(record_seconds);
+}
+
+void autoload_preload_finish() {
+    ASSERT_IS_MAIN_THREAD();
+    preload_recording_t &rec = s_preload_recording;
+    if (!rec.active) return;
+    rec.active = false;
+
+    std::string contents;
+    for (const wcstring &path : rec.paths) {
+        contents.append(wcs2string(path));
+        contents.push_back('\n');
+    }
+
+    // Write to a temporary file and move it into place, so another session never reads a partial
+    // manifest.
+    wcstring tmp_path = format_string(L"%ls.%d.tmp", rec.manifest_path.c_str(), getpid());
+    autoclose_fd_t fd{wopen_cloexec(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600)};
+    if (!fd.valid()) {
+        FLOGF(warning, _(L"Unable to write autoload preload manifest '%ls'"), tmp_path.c_str());
+        return;
+    }
+    FLOGF(autoload, L"Writing %lu files to '%ls'", static_cast<unsigned long>(rec.paths.size()),
+          rec.manifest_path.c_str());
+    bool ok = write_loop(fd.fd(), contents.data(), contents.size()) >= 0;
+    fd.close();
+    if (!ok || wrename(tmp_path, rec.manifest_path) != 0) {
+        FLOGF(warning, _(L"Unable to write autoload preload manifest '%ls'"),
+              rec.manifest_path.c_str());
+        wunlink(tmp_path);
+    }
+}
+
+parsed_source_ref_t autoload_take_preloaded(const wcstring &path, const file_id_t &file_id) {
+    auto files = s_preloaded_files.acquire();
+    auto iter = files->find(path);
+    if (iter == files->end()) return nullptr;
+    parsed_source_ref_t result;
+    if (iter->second.file_id == file_id) {
+        FLOGF(autoload, L"Using preloaded '%ls'", path.c_str());
+        result = std::move(iter->second.source);
+    }
+    files->erase(iter);
+    return result;
+}
+
+/// Note that \p path is being autoloaded, for the preload manifest.
+static void preload_record(const wcstring &path) {
+    ASSERT_IS_MAIN_THREAD();
+    preload_recording_t &rec = s_preload_recording;
+    if (!rec.active) return;
+    if (std::chrono::steady_clock::now() >= rec.deadline) {
+        autoload_preload_finish();
+    } else if (rec.seen.insert(path).second) {
+        rec.paths.push_back(path);
+    }
+}
@@ -11,6 +11,7 @@
 
 #include "common.h"
 #include "env.h"
+#include "parse_tree.h"
 #include "wutil.h"
 
 class autoload_file_cache_t;
@@ -92,6 +93,11 @@ class autoload_t {
     /// commands.
     wcstring_list_t get_autoloaded_commands() const;
 
+    /// \return the names of all commands that could be autoloaded from the paths in \p env. This
+    /// uses the listings of the directories kept for resolving commands, which are only re-read
+    /// when the directories change.
+    wcstring_list_t get_autoloadable_commands(const environment_t &env);
+
     /// Mark that all autoloaded files have been forgotten.
     /// Future calls to path_to_autoload() will return previously-returned paths.
     void clear() {
@@ -100,4 +106,20 @@ class autoload_t {
     }
 };
 
+/// Preloading lets an interactive session have the functions and completions that the previous
+/// session autoloaded early on read and parsed ahead of time, in parallel, instead of one by one as
+/// they are first used.
+///
+/// Start reading and parsing the files listed in the manifest at \p manifest_path on background
+/// threads. Also start recording the files autoloaded in the next \p record_seconds, which are
+/// written to the manifest for the next session.
+void autoload_preload_start(const wcstring &manifest_path, int record_seconds);
+
+/// Stop recording, and write the files recorded so far to the manifest.
+void autoload_preload_finish();
+
+/// \return the parsed contents of the script at \p path if it was preloaded and is the same file
+/// as \p file_id, or null if not. Each preloaded file is handed out once.
+parsed_source_ref_t autoload_take_preloaded(const wcstring &path, const file_id_t &file_id);
+
 #endif
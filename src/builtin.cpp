@@ -97,6 +97,48 @@ int builtin_count_args(const wchar_t *const *argv) {
     return argc;
 }
 
+/// \return the run of arguments from a bare variable which starts at \p args, if there is one
+/// and it fits in the \p count arguments.
+static const argv_var_span_t *builtin_var_span_at(const io_streams_t &streams,
+                                                  const wchar_t *const *args, size_t count) {
+    if (!streams.argv_list || !streams.argv_var_spans) return nullptr;
+    const wcstring_list_t &argv_list = *streams.argv_list;
+    for (const argv_var_span_t &span : *streams.argv_var_spans) {
+        size_t size = span.var.as_list().size();
+        if (size > count || args[0] != argv_list.at(span.start).c_str()) continue;
+        // Option parsing may have moved arguments around; check the whole run is still in place.
+        size_t i = 1;
+        while (i < size && args[i] == argv_list.at(span.start + i).c_str()) i++;
+        if (i == size) return &span;
+    }
+    return nullptr;
+}
+
+/// Counts the arguments in argv[start, end) equal to \p needle, storing the index of the first in
+/// \p first, stopping there if \p first_only is set. Arguments which came from a bare variable are
+/// searched through the variable's index instead of one by one.
+size_t builtin_find_args(const io_streams_t &streams, const wchar_t *const *argv, int start,
+                         int end, const wcstring &needle, int *first, bool first_only) {
+    size_t count = 0;
+    int i = start;
+    while (i < end && !(first_only && count > 0)) {
+        if (const argv_var_span_t *span = builtin_var_span_at(streams, argv + i, end - i)) {
+            size_t span_first = 0;
+            size_t found = span->var.count_values(needle, &span_first);
+            if (found > 0 && count == 0 && first) *first = i + static_cast<int>(span_first);
+            count += found;
+            i += static_cast<int>(span->var.as_list().size());
+        } else {
+            if (needle == argv[i]) {
+                if (count == 0 && first) *first = i;
+                count++;
+            }
+            i++;
+        }
+    }
+    return count;
+}
+
 /// This function works like wperror, but it prints its result into the streams.err string instead
 /// to stderr. Used by the builtin commands.
 void builtin_wperror(const wchar_t *s, io_streams_t &streams) {
@@ -343,8 +385,8 @@ maybe_t<int> builtin_gettext(parser_t &parser, io_streams_t &streams, wchar_t **
 // Data about all the builtin commands in fish.
 // Functions that are bound to builtin_generic are handled directly by the parser.
 // NOTE: These must be kept in sorted order!
-static const builtin_data_t builtin_datas[] = {
-    {L".", &builtin_source, N_(L"Evaluate contents of file")},
+static constexpr builtin_data_t builtin_datas[] = {
+    {L".", &builtin_source, N_(L"Evaluate contents of file"), true},
     {L":", &builtin_true, N_(L"Return a successful result")},
     {L"[", &builtin_test, N_(L"Test a condition")},
     {L"_", &builtin_gettext, N_(L"Translate a string")},
@@ -356,7 +398,7 @@ static const builtin_data_t builtin_datas[] = {
     {L"block", &builtin_block, N_(L"Temporarily block delivery of events")},
     {L"break", &builtin_break_continue, N_(L"Stop the innermost loop")},
     {L"breakpoint", &builtin_breakpoint,
-     N_(L"Temporarily halt execution of a script and launch an interactive debug prompt")},
+     N_(L"Temporarily halt execution of a script and launch an interactive debug prompt"), true},
     {L"builtin", &builtin_builtin, N_(L"Run a builtin command instead of a function")},
     {L"case", &builtin_generic, N_(L"Conditionally execute a block of commands")},
     {L"cd", &builtin_cd, N_(L"Change working directory")},
@@ -366,7 +408,7 @@ static const builtin_data_t builtin_datas[] = {
     {L"contains", &builtin_contains, N_(L"Search for a specified string in a list")},
     {L"continue", &builtin_break_continue,
      N_(L"Skip the rest of the current lap of the innermost loop")},
-    {L"count", &builtin_count, N_(L"Count the number of arguments")},
+    {L"count", &builtin_count, N_(L"Count the number of arguments"), true},
     {L"disown", &builtin_disown, N_(L"Remove job from job list")},
     {L"echo", &builtin_echo, N_(L"Print arguments")},
     {L"else", &builtin_generic, N_(L"Evaluate block if condition is false")},
@@ -383,7 +425,7 @@ static const builtin_data_t builtin_datas[] = {
     {L"history", &builtin_history, N_(L"History of commands executed by user")},
     {L"if", &builtin_generic, N_(L"Evaluate block if condition is true")},
     {L"jobs", &builtin_jobs, N_(L"Print currently running jobs")},
-    {L"math", &builtin_math, N_(L"Evaluate math expressions")},
+    {L"math", &builtin_math, N_(L"Evaluate math expressions"), true},
     {L"not", &builtin_generic, N_(L"Negate exit status of job")},
     {L"or", &builtin_generic, N_(L"Execute command if previous command failed")},
     {L"printf", &builtin_printf, N_(L"Prints formatted text")},
@@ -394,9 +436,9 @@ static const builtin_data_t builtin_datas[] = {
     {L"return", &builtin_return, N_(L"Stop the currently evaluated function")},
     {L"set", &builtin_set, N_(L"Handle environment variables")},
     {L"set_color", &builtin_set_color, N_(L"Set the terminal color")},
-    {L"source", &builtin_source, N_(L"Evaluate contents of file")},
+    {L"source", &builtin_source, N_(L"Evaluate contents of file"), true},
     {L"status", &builtin_status, N_(L"Return status information about fish")},
-    {L"string", &builtin_string, N_(L"Manipulate strings")},
+    {L"string", &builtin_string, N_(L"Manipulate strings"), true},
     {L"switch", &builtin_generic, N_(L"Conditionally execute a block of commands")},
     {L"test", &builtin_test, N_(L"Test a condition")},
     {L"time", &builtin_generic, N_(L"Measure how long a command or block takes")},
@@ -408,18 +450,36 @@ static const builtin_data_t builtin_datas[] = {
 
 #define BUILTIN_COUNT (sizeof builtin_datas / sizeof *builtin_datas)
 
-/// Look up a builtin_data_t for a specified builtin
-///
-/// @param  name
-///    Name of the builtin
-///
-/// @return
-///    Pointer to a builtin_data_t
-///
-static const builtin_data_t *builtin_lookup(const wcstring &name) {
-    const builtin_data_t *array_end = builtin_datas + BUILTIN_COUNT;
-    const builtin_data_t *found = std::lower_bound(builtin_datas, array_end, name);
-    if (found != array_end && name == found->name) {
+// Builtins are found through a perfect hash table, so a lookup is one hash and one comparison.
+// If the static_assert fires after adding a builtin, try other seeds until one works.
+static constexpr uint32_t kBuiltinHashSeed = 1181;
+static constexpr unsigned kBuiltinHashBits = 8;
+static_assert(names_hash_perfectly(builtin_datas, BUILTIN_COUNT, &builtin_data_t::name,
+                                   kBuiltinHashSeed, kBuiltinHashBits),
+              "builtin names collide in the hash table");
+
+namespace {
+struct builtin_hash_table_t {
+    const builtin_data_t *slots[1 << kBuiltinHashBits]{};
+    // No builtin name is longer than this, so longer names don't need hashing.
+    size_t max_name_length{0};
+
+    builtin_hash_table_t() {
+        for (const builtin_data_t &data : builtin_datas) {
+            slots[name_hash_slot(data.name, kBuiltinHashSeed, kBuiltinHashBits)] = &data;
+            max_name_length = std::max(max_name_length, std::wcslen(data.name));
+        }
+    }
+};
+}  // namespace
+
+/// Look up the builtin with the given name, returning null if there is none.
+const builtin_data_t *builtin_lookup(const wcstring &name) {
+    static const builtin_hash_table_t table;
+    if (name.size() > table.max_name_length) return nullptr;
+    const builtin_data_t *found =
+        table.slots[name_hash_slot(name.c_str(), kBuiltinHashSeed, kBuiltinHashBits)];
+    if (found && name == found->name) {
         return found;
     }
     return nullptr;
@@ -443,8 +503,10 @@ static const wchar_t *const help_builtins[] = {L"for", L"while",  L"function", L
                                                L"end", L"switch", L"case"};
 static bool cmd_needs_help(const wchar_t *cmd) { return contains(help_builtins, cmd); }
 
-/// Execute a builtin command
-proc_status_t builtin_run(parser_t &parser, wchar_t **argv, io_streams_t &streams) {
+/// Execute a builtin command. \p data is the builtin named by argv[0], if the caller has already
+/// looked it up.
+proc_status_t builtin_run(parser_t &parser, wchar_t **argv, io_streams_t &streams,
+                          const builtin_data_t *data) {
     UNUSED(parser);
     UNUSED(streams);
     if (argv == nullptr || argv[0] == nullptr)
@@ -458,7 +520,8 @@ proc_status_t builtin_run(parser_t &parser, wchar_t **argv, io_streams_t &stream
         return proc_status_t::from_exit_code(STATUS_CMD_OK);
     }
 
-    if (const builtin_data_t *data = builtin_lookup(argv[0])) {
+    if (!data) data = builtin_lookup(argv[0]);
+    if (data) {
         maybe_t<int> ret = data->func(parser, streams, argv);
         if (!ret) {
             return proc_status_t::empty();
@@ -17,12 +17,20 @@ using completion_list_t = std::vector<completion_t>;
 
 /// Data structure to describe a builtin.
 struct builtin_data_t {
+    using func_t = maybe_t<int> (*)(parser_t &parser, io_streams_t &streams, wchar_t **argv);
+
     // Name of the builtin.
     const wchar_t *name;
     // Function pointer to the builtin implementation.
-    maybe_t<int> (*func)(parser_t &parser, io_streams_t &streams, wchar_t **argv);
+    func_t func;
     // Description of what the builtin does.
     const wchar_t *desc;
+    // Whether the builtin may read its stdin.
+    bool reads_stdin;
+
+    constexpr builtin_data_t(const wchar_t *name, func_t func, const wchar_t *desc,
+                             bool reads_stdin = false)
+        : name(name), func(func), desc(desc), reads_stdin(reads_stdin) {}
 
     bool operator<(const wcstring &) const;
     bool operator<(const builtin_data_t *) const;
@@ -79,9 +87,11 @@ enum { COMMAND_NOT_BUILTIN, BUILTIN_REGULAR, BUILTIN_FUNCTION };
 #define FG_MSG _(L"Send job %d, '%ls' to foreground\n")
 
 void builtin_init();
+const builtin_data_t *builtin_lookup(const wcstring &name);
 bool builtin_exists(const wcstring &cmd);
 
-proc_status_t builtin_run(parser_t &parser, wchar_t **argv, io_streams_t &streams);
+proc_status_t builtin_run(parser_t &parser, wchar_t **argv, io_streams_t &streams,
+                          const builtin_data_t *data = nullptr);
 
 wcstring_list_t builtin_get_names();
 void builtin_get_names(completion_list_t *list);
@@ -92,6 +102,9 @@ wcstring builtin_help_get(parser_t &parser, const wchar_t *cmd);
 void builtin_print_help(parser_t &parser, const io_streams_t &streams, const wchar_t *name,
                         wcstring *error_message = nullptr);
 int builtin_count_args(const wchar_t *const *argv);
+size_t builtin_find_args(const io_streams_t &streams, const wchar_t *const *argv, int start,
+                         int end, const wcstring &needle, int *first = nullptr,
+                         bool first_only = false);
 
 void builtin_unknown_option(parser_t &parser, io_streams_t &streams, const wchar_t *cmd,
                             const wchar_t *opt);
@@ -22,6 +22,7 @@
 #include "exec.h"
 #include "fallback.h"  // IWYU pragma: keep
 #include "io.h"
+#include "lru.h"
 #include "parser.h"
 #include "wcstringutil.h"
 #include "wgetopt.h"  // IWYU pragma: keep
@@ -31,33 +32,66 @@ static const wcstring var_name_prefix = L"_flag_";
 
 #define BUILTIN_ERR_INVALID_OPT_SPEC _(L"%ls: Invalid option spec '%ls' at char '%lc'\n")
 
+/// The number of compiled option specs to keep.
+static constexpr size_t kSpecCacheSize = 64;
+
 struct option_spec_t {
     const wchar_t short_flag;
     wcstring long_flag;
     wcstring validation_command;
-    wcstring_list_t vals;
     bool short_flag_valid{true};
     int num_allowed{0};
-    int num_seen{0};
+    /// Where this option's results go in argparse_cmd_opts_t::results.
+    size_t index{0};
 
     explicit option_spec_t(wchar_t s) : short_flag(s) {}
 };
 using option_spec_ref_t = std::unique_ptr<option_spec_t>;
 
-struct argparse_cmd_opts_t {
+/// What one call to argparse found for an option.
+struct option_result_t {
+    wcstring_list_t vals;
+    int num_seen{0};
+};
+
+/// The flags and option specs given to argparse, compiled for parsing arguments. This does not
+/// change once compiled, so that calls with the same flags and specs can share it.
+struct argparse_spec_t {
     bool ignore_unknown = false;
-    bool print_help = false;
     bool stop_nonopt = false;
     size_t min_args = 0;
     size_t max_args = SIZE_MAX;
     wchar_t implicit_int_flag = L'\0';
-    wcstring name;
     wcstring_list_t raw_exclusive_flags;
-    wcstring_list_t argv;
     std::unordered_map<wchar_t, option_spec_ref_t> options;
     std::unordered_map<wcstring, wchar_t> long_to_short_flag;
     std::vector<std::vector<wchar_t>> exclusive_flag_sets;
+    /// The options for wgetopt. The long options point into the specs' long flags.
+    wcstring short_options;
+    std::vector<woption> long_options;
+};
+using argparse_spec_ref_t = std::shared_ptr<const argparse_spec_t>;
+
+struct argparse_cmd_opts_t {
+    bool print_help = false;
+    wcstring name;
+    argparse_spec_ref_t spec;
+    wcstring_list_t argv;
+    /// The results for each option, by option_spec_t::index.
+    std::vector<option_result_t> results;
+
+    option_result_t &result_for(const option_spec_t &opt_spec) {
+        return results.at(opt_spec.index);
+    }
+};
+
+/// Compiled specs, keyed by argparse's own arguments up to the "--" that ends the option specs.
+/// Functions usually start by calling argparse with the same specs every time.
+class spec_cache_t : public lru_cache_t<spec_cache_t, argparse_spec_ref_t> {
+   public:
+    spec_cache_t() : lru_cache_t<spec_cache_t, argparse_spec_ref_t>(kSpecCacheSize) {}
 };
+static owning_lock<spec_cache_t> s_spec_cache;
 
 static const wchar_t *const short_options = L"+:hn:six:N:X:";
 static const struct woption long_options[] = {
@@ -68,28 +102,29 @@ static const struct woption long_options[] = {
 
 // Check if any pair of mutually exclusive options was seen. Note that since every option must have
 // a short name we only need to check those.
-static int check_for_mutually_exclusive_flags(const argparse_cmd_opts_t &opts,
+static int check_for_mutually_exclusive_flags(argparse_cmd_opts_t &opts,
                                               io_streams_t &streams) {
-    for (const auto &kv : opts.options) {
+    const argparse_spec_t &spec = *opts.spec;
+    for (const auto &kv : spec.options) {
         const auto &opt_spec = kv.second;
-        if (opt_spec->num_seen == 0) continue;
+        if (opts.result_for(*opt_spec).num_seen == 0) continue;
 
         // We saw this option at least once. Check all the sets of mutually exclusive options to see
         // if this option appears in any of them.
-        for (const auto &xarg_set : opts.exclusive_flag_sets) {
+        for (const auto &xarg_set : spec.exclusive_flag_sets) {
             if (contains(xarg_set, opt_spec->short_flag)) {
                 // Okay, this option is in a mutually exclusive set of options. Check if any of the
                 // other mutually exclusive options have been seen.
                 for (const auto &xflag : xarg_set) {
-                    auto xopt_spec_iter = opts.options.find(xflag);
-                    if (xopt_spec_iter == opts.options.end()) continue;
+                    auto xopt_spec_iter = spec.options.find(xflag);
+                    if (xopt_spec_iter == spec.options.end()) continue;
 
                     const auto &xopt_spec = xopt_spec_iter->second;
                     // Ignore this flag in the list of mutually exclusive flags.
                     if (xopt_spec->short_flag == opt_spec->short_flag) continue;
 
                     // If it is a different flag check if it has been seen.
-                    if (xopt_spec->num_seen) {
+                    if (opts.result_for(*xopt_spec).num_seen) {
                         wcstring flag1;
                         if (opt_spec->short_flag_valid) flag1 = wcstring(1, opt_spec->short_flag);
                         if (!opt_spec->long_flag.empty()) {
@@ -121,48 +156,49 @@ static int check_for_mutually_exclusive_flags(const argparse_cmd_opts_t &opts,
 
 // This should be called after all the option specs have been parsed. At that point we have enough
 // information to parse the values associated with any `--exclusive` flags.
-static int parse_exclusive_args(argparse_cmd_opts_t &opts, io_streams_t &streams) {
-    for (const wcstring &raw_xflags : opts.raw_exclusive_flags) {
+static int parse_exclusive_args(argparse_spec_t &spec, const wcstring &name,
+                                io_streams_t &streams) {
+    for (const wcstring &raw_xflags : spec.raw_exclusive_flags) {
         const wcstring_list_t xflags = split_string(raw_xflags, L',');
         if (xflags.size() < 2) {
             streams.err.append_format(_(L"%ls: exclusive flag string '%ls' is not valid\n"),
-                                      opts.name.c_str(), raw_xflags.c_str());
+                                      name.c_str(), raw_xflags.c_str());
             return STATUS_CMD_ERROR;
         }
 
         std::vector<wchar_t> exclusive_set;
         for (const auto &flag : xflags) {
-            if (flag.size() == 1 && opts.options.find(flag[0]) != opts.options.end()) {
+            if (flag.size() == 1 && spec.options.find(flag[0]) != spec.options.end()) {
                 // It's a short flag.
                 exclusive_set.push_back(flag[0]);
             } else {
-                auto x = opts.long_to_short_flag.find(flag);
-                if (x != opts.long_to_short_flag.end()) {
+                auto x = spec.long_to_short_flag.find(flag);
+                if (x != spec.long_to_short_flag.end()) {
                     // It's a long flag we store as its short flag equivalent.
                     exclusive_set.push_back(x->second);
                 } else {
                     streams.err.append_format(_(L"%ls: exclusive flag '%ls' is not valid\n"),
-                                              opts.name.c_str(), flag.c_str());
+                                              name.c_str(), flag.c_str());
                     return STATUS_CMD_ERROR;
                 }
             }
         }
 
         // Store the set of exclusive flags for use when parsing the supplied set of arguments.
-        opts.exclusive_flag_sets.push_back(exclusive_set);
+        spec.exclusive_flag_sets.push_back(exclusive_set);
     }
 
     return STATUS_CMD_OK;
 }
 
-static bool parse_flag_modifiers(const argparse_cmd_opts_t &opts, const option_spec_ref_t &opt_spec,
-                                 const wcstring &option_spec, const wchar_t **opt_spec_str,
-                                 io_streams_t &streams) {
+static bool parse_flag_modifiers(const argparse_spec_t &spec, const wcstring &name,
+                                 const option_spec_ref_t &opt_spec, const wcstring &option_spec,
+                                 const wchar_t **opt_spec_str, io_streams_t &streams) {
     const wchar_t *s = *opt_spec_str;
-    if (opt_spec->short_flag == opts.implicit_int_flag && *s && *s != L'!') {
+    if (opt_spec->short_flag == spec.implicit_int_flag && *s && *s != L'!') {
         streams.err.append_format(
             _(L"%ls: Implicit int short flag '%lc' does not allow modifiers like '%lc'\n"),
-            opts.name.c_str(), opt_spec->short_flag, *s);
+            name.c_str(), opt_spec->short_flag, *s);
         return false;
     }
 
@@ -185,18 +221,18 @@ static bool parse_flag_modifiers(const argparse_cmd_opts_t &opts, const option_s
         // Move cursor to the end so we don't expect a long flag.
         while (*s) s++;
     } else if (*s) {
-        streams.err.append_format(BUILTIN_ERR_INVALID_OPT_SPEC, opts.name.c_str(),
+        streams.err.append_format(BUILTIN_ERR_INVALID_OPT_SPEC, name.c_str(),
                                   option_spec.c_str(), *s);
         return false;
     }
 
     // Make sure we have some validation for implicit int flags.
-    if (opt_spec->short_flag == opts.implicit_int_flag && opt_spec->validation_command.empty()) {
+    if (opt_spec->short_flag == spec.implicit_int_flag && opt_spec->validation_command.empty()) {
         opt_spec->validation_command = L"_validate_int";
     }
 
-    if (opts.options.find(opt_spec->short_flag) != opts.options.end()) {
-        streams.err.append_format(L"%ls: Short flag '%lc' already defined\n", opts.name.c_str(),
+    if (spec.options.find(opt_spec->short_flag) != spec.options.end()) {
+        streams.err.append_format(L"%ls: Short flag '%lc' already defined\n", name.c_str(),
                                   opt_spec->short_flag);
         return false;
     }
@@ -206,53 +242,53 @@ static bool parse_flag_modifiers(const argparse_cmd_opts_t &opts, const option_s
 }
 
 /// Parse the text following the short flag letter.
-static bool parse_option_spec_sep(argparse_cmd_opts_t &opts, const option_spec_ref_t &opt_spec,
-                                  const wcstring &option_spec, const wchar_t **opt_spec_str,
-                                  io_streams_t &streams) {
+static bool parse_option_spec_sep(argparse_spec_t &spec, const wcstring &name,
+                                  const option_spec_ref_t &opt_spec, const wcstring &option_spec,
+                                  const wchar_t **opt_spec_str, io_streams_t &streams) {
     const wchar_t *s = *opt_spec_str;
     if (*(s - 1) == L'#') {
         if (*s != L'-') {
             streams.err.append_format(
                 _(L"%ls: Short flag '#' must be followed by '-' and a long name\n"),
-                opts.name.c_str());
+                name.c_str());
             return false;
         }
-        if (opts.implicit_int_flag) {
+        if (spec.implicit_int_flag) {
             streams.err.append_format(_(L"%ls: Implicit int flag '%lc' already defined\n"),
-                                      opts.name.c_str(), opts.implicit_int_flag);
+                                      name.c_str(), spec.implicit_int_flag);
             return false;
         }
-        opts.implicit_int_flag = opt_spec->short_flag;
+        spec.implicit_int_flag = opt_spec->short_flag;
         opt_spec->short_flag_valid = false;
         s++;
     } else if (*s == L'-') {
         opt_spec->short_flag_valid = false;
         s++;
         if (!*s) {
-            streams.err.append_format(BUILTIN_ERR_INVALID_OPT_SPEC, opts.name.c_str(),
+            streams.err.append_format(BUILTIN_ERR_INVALID_OPT_SPEC, name.c_str(),
                                       option_spec.c_str(), *(s - 1));
             return false;
         }
     } else if (*s == L'/') {
         s++;  // the struct is initialized assuming short_flag_valid should be true
         if (!*s) {
-            streams.err.append_format(BUILTIN_ERR_INVALID_OPT_SPEC, opts.name.c_str(),
+            streams.err.append_format(BUILTIN_ERR_INVALID_OPT_SPEC, name.c_str(),
                                       option_spec.c_str(), *(s - 1));
             return false;
         }
     } else if (*s == L'#') {
-        if (opts.implicit_int_flag) {
+        if (spec.implicit_int_flag) {
             streams.err.append_format(_(L"%ls: Implicit int flag '%lc' already defined\n"),
-                                      opts.name.c_str(), opts.implicit_int_flag);
+                                      name.c_str(), spec.implicit_int_flag);
             return false;
         }
-        opts.implicit_int_flag = opt_spec->short_flag;
+        spec.implicit_int_flag = opt_spec->short_flag;
         opt_spec->num_allowed = 1;  // mandatory arg and can appear only once
         s++;  // the struct is initialized assuming short_flag_valid should be true
     } else {
         // Long flag name not allowed if second char isn't '/', '-' or '#' so just check for
         // behavior modifier chars.
-        if (!parse_flag_modifiers(opts, opt_spec, option_spec, &s, streams)) return false;
+        if (!parse_flag_modifiers(spec, name, opt_spec, option_spec, &s, streams)) return false;
     }
 
     *opt_spec_str = s;
@@ -260,25 +296,26 @@ static bool parse_option_spec_sep(argparse_cmd_opts_t &opts, const option_spec_r
 }
 
 /// This parses an option spec string into a struct option_spec.
-static bool parse_option_spec(argparse_cmd_opts_t &opts,  //!OCLINT(high npath complexity)
-                              const wcstring &option_spec, io_streams_t &streams) {
+static bool parse_option_spec(argparse_spec_t &spec,  //!OCLINT(high npath complexity)
+                              const wcstring &name, const wcstring &option_spec,
+                              io_streams_t &streams) {
     if (option_spec.empty()) {
         streams.err.append_format(_(L"%ls: An option spec must have a short flag letter\n"),
-                                  opts.name.c_str());
+                                  name.c_str());
         return false;
     }
 
     const wchar_t *s = option_spec.c_str();
     if (!iswalnum(*s) && *s != L'#') {
         streams.err.append_format(_(L"%ls: Short flag '%lc' invalid, must be alphanum or '#'\n"),
-                                  opts.name.c_str(), *s);
+                                  name.c_str(), *s);
         return false;
     }
 
     std::unique_ptr<option_spec_t> opt_spec(new option_spec_t{*s++});
 
     // Try parsing stuff after the short flag.
-    if (*s && !parse_option_spec_sep(opts, opt_spec, option_spec, &s, streams)) {
+    if (*s && !parse_option_spec_sep(spec, name, opt_spec, option_spec, &s, streams)) {
         return false;
     }
 
@@ -288,31 +325,32 @@ static bool parse_option_spec(argparse_cmd_opts_t &opts,  //!OCLINT(high npath c
         while (*s && (*s == L'-' || *s == L'_' || iswalnum(*s))) s++;
         if (s != long_flag_start) {
             opt_spec->long_flag = wcstring(long_flag_start, s);
-            if (opts.long_to_short_flag.count(opt_spec->long_flag) > 0) {
+            if (spec.long_to_short_flag.count(opt_spec->long_flag) > 0) {
                 streams.err.append_format(L"%ls: Long flag '%ls' already defined\n",
-                                          opts.name.c_str(), opt_spec->long_flag.c_str());
+                                          name.c_str(), opt_spec->long_flag.c_str());
                 return false;
             }
         }
     }
-    if (!parse_flag_modifiers(opts, opt_spec, option_spec, &s, streams)) {
+    if (!parse_flag_modifiers(spec, name, opt_spec, option_spec, &s, streams)) {
         return false;
     }
 
     // Record our long flag if we have one.
     if (!opt_spec->long_flag.empty()) {
-        auto ins = opts.long_to_short_flag.emplace(opt_spec->long_flag, opt_spec->short_flag);
+        auto ins = spec.long_to_short_flag.emplace(opt_spec->long_flag, opt_spec->short_flag);
         assert(ins.second && "Should have inserted long flag");
         (void)ins;
     }
 
     // Record our option under its short flag.
-    opts.options[opt_spec->short_flag] = std::move(opt_spec);
+    opt_spec->index = spec.options.size();
+    spec.options[opt_spec->short_flag] = std::move(opt_spec);
     return true;
 }
 
-static int collect_option_specs(argparse_cmd_opts_t &opts, int *optind, int argc, wchar_t **argv,
-                                io_streams_t &streams) {
+static int collect_option_specs(argparse_spec_t &spec, const wcstring &name, int *optind,
+                                int argc, wchar_t **argv, io_streams_t &streams) {
     wchar_t *cmd = argv[0];
 
     while (true) {
@@ -321,7 +359,7 @@ static int collect_option_specs(argparse_cmd_opts_t &opts, int *optind, int argc
             break;
         }
 
-        if (!parse_option_spec(opts, argv[*optind], streams)) {
+        if (!parse_option_spec(spec, name, argv[*optind], streams)) {
             return STATUS_CMD_ERROR;
         }
 
@@ -331,7 +369,7 @@ static int collect_option_specs(argparse_cmd_opts_t &opts, int *optind, int argc
         }
     }
 
-    if (opts.options.empty()) {
+    if (spec.options.empty()) {
         streams.err.append_format(_(L"%ls: No option specs were provided\n"), cmd);
         return STATUS_INVALID_ARGS;
     }
@@ -339,9 +377,50 @@ static int collect_option_specs(argparse_cmd_opts_t &opts, int *optind, int argc
     return STATUS_CMD_OK;
 }
 
+static void populate_option_strings(const argparse_spec_t &spec, wcstring *short_options,
+                                    std::vector<woption> *long_options) {
+    for (const auto &kv : spec.options) {
+        const auto &opt_spec = kv.second;
+        if (opt_spec->short_flag_valid) short_options->push_back(opt_spec->short_flag);
+
+        int arg_type = no_argument;
+        if (opt_spec->num_allowed == -1) {
+            arg_type = optional_argument;
+            if (opt_spec->short_flag_valid) short_options->append(L"::");
+        } else if (opt_spec->num_allowed > 0) {
+            arg_type = required_argument;
+            if (opt_spec->short_flag_valid) short_options->append(L":");
+        }
+
+        if (!opt_spec->long_flag.empty()) {
+            long_options->push_back(
+                {opt_spec->long_flag.c_str(), arg_type, nullptr, opt_spec->short_flag});
+        }
+    }
+    long_options->push_back({nullptr, 0, nullptr, 0});
+}
+
+/// Compile the option specs, which start at \p *optind, into \p spec.
+static int compile_spec(argparse_spec_t &spec, const wcstring &name, int *optind, int argc,
+                        wchar_t **argv, io_streams_t &streams) {
+    int retval = collect_option_specs(spec, name, optind, argc, argv, streams);
+    if (retval != STATUS_CMD_OK) return retval;
+
+    retval = parse_exclusive_args(spec, name, streams);
+    if (retval != STATUS_CMD_OK) return retval;
+
+    // "+" means stop at nonopt, "-" means give nonoptions the option character code `1`, and don't
+    // reorder.
+    spec.short_options = spec.stop_nonopt ? L"+:" : L"-:";
+    populate_option_strings(spec, &spec.short_options, &spec.long_options);
+    return STATUS_CMD_OK;
+}
+
 static int parse_cmd_opts(argparse_cmd_opts_t &opts, int *optind,  //!OCLINT(high ncss method)
                           int argc, wchar_t **argv, parser_t &parser, io_streams_t &streams) {
     wchar_t *cmd = argv[0];
+    // A fresh spec for our own flags. Unless it is already cached, the option specs are added.
+    auto spec = std::make_shared<argparse_spec_t>();
     int opt;
     wgetopter_t w;
     while ((opt = w.wgetopt_long(argc, argv, short_options, long_options, nullptr)) != -1) {
@@ -351,17 +430,17 @@ static int parse_cmd_opts(argparse_cmd_opts_t &opts, int *optind,  //!OCLINT(hig
                 break;
             }
             case 's': {
-                opts.stop_nonopt = true;
+                spec->stop_nonopt = true;
                 break;
             }
             case 'i': {
-                opts.ignore_unknown = true;
+                spec->ignore_unknown = true;
                 break;
             }
             case 'x': {
                 // Just save the raw string here. Later, when we have all the short and long flag
                 // definitions we'll parse these strings into a more useful data structure.
-                opts.raw_exclusive_flags.push_back(w.woptarg);
+                spec->raw_exclusive_flags.push_back(w.woptarg);
                 break;
             }
             case 'h': {
@@ -375,7 +454,7 @@ static int parse_cmd_opts(argparse_cmd_opts_t &opts, int *optind,  //!OCLINT(hig
                                               w.woptarg);
                     return STATUS_INVALID_ARGS;
                 }
-                opts.min_args = x;
+                spec->min_args = x;
                 break;
             }
             case 'X': {
@@ -385,7 +464,7 @@ static int parse_cmd_opts(argparse_cmd_opts_t &opts, int *optind,  //!OCLINT(hig
                                               w.woptarg);
                     return STATUS_INVALID_ARGS;
                 }
-                opts.max_args = x;
+                spec->max_args = x;
                 break;
             }
             case ':': {
@@ -419,35 +498,34 @@ static int parse_cmd_opts(argparse_cmd_opts_t &opts, int *optind,  //!OCLINT(hig
         opts.name = fn;
     }
 
-    *optind = w.woptind;
-    return collect_option_specs(opts, optind, argc, argv, streams);
-}
-
-static void populate_option_strings(const argparse_cmd_opts_t &opts, wcstring *short_options,
-                                    std::vector<woption> *long_options) {
-    for (const auto &kv : opts.options) {
-        const auto &opt_spec = kv.second;
-        if (opt_spec->short_flag_valid) short_options->push_back(opt_spec->short_flag);
-
-        int arg_type = no_argument;
-        if (opt_spec->num_allowed == -1) {
-            arg_type = optional_argument;
-            if (opt_spec->short_flag_valid) short_options->append(L"::");
-        } else if (opt_spec->num_allowed > 0) {
-            arg_type = required_argument;
-            if (opt_spec->short_flag_valid) short_options->append(L":");
+    // The cache key is our arguments up to the "--" after the option specs. Failures are not
+    // cached, so the name that goes into error messages does not matter.
+    wcstring key;
+    int specs_end = w.woptind;
+    while (specs_end < argc && std::wcscmp(L"--", argv[specs_end]) != 0) specs_end++;
+    if (specs_end < argc) {
+        for (int i = 1; i < specs_end; i++) {
+            key.append(argv[i]);
+            key.push_back(L'\0');
         }
-
-        if (!opt_spec->long_flag.empty()) {
-            long_options->push_back(
-                {opt_spec->long_flag.c_str(), arg_type, nullptr, opt_spec->short_flag});
+        if (argparse_spec_ref_t *cached = s_spec_cache.acquire()->get(key)) {
+            opts.spec = *cached;
+            *optind = specs_end + 1;
+            return STATUS_CMD_OK;
         }
     }
-    long_options->push_back({nullptr, 0, nullptr, 0});
+
+    *optind = w.woptind;
+    int retval = compile_spec(*spec, opts.name, optind, argc, argv, streams);
+    if (retval != STATUS_CMD_OK) return retval;
+    opts.spec = spec;
+    if (!key.empty()) s_spec_cache.acquire()->insert(std::move(key), opts.spec);
+    return STATUS_CMD_OK;
 }
 
-static int validate_arg(parser_t &parser, const argparse_cmd_opts_t &opts, option_spec_t *opt_spec,
-                        bool is_long_flag, const wchar_t *woptarg, io_streams_t &streams) {
+static int validate_arg(parser_t &parser, const argparse_cmd_opts_t &opts,
+                        const option_spec_t *opt_spec, bool is_long_flag, const wchar_t *woptarg,
+                        io_streams_t &streams) {
     // Obviously if there is no arg validation command we assume the arg is okay.
     if (opt_spec->validation_command.empty()) return STATUS_CMD_OK;
 
@@ -476,7 +554,7 @@ static int validate_arg(parser_t &parser, const argparse_cmd_opts_t &opts, optio
 
 /// \return whether the option 'opt' is an implicit integer option.
 static bool is_implicit_int(const argparse_cmd_opts_t &opts, const wchar_t *val) {
-    if (opts.implicit_int_flag == L'\0') {
+    if (opts.spec->implicit_int_flag == L'\0') {
         // There is no implicit integer option.
         return false;
     }
@@ -488,35 +566,37 @@ static bool is_implicit_int(const argparse_cmd_opts_t &opts, const wchar_t *val)
 }
 
 // Store this value under the implicit int option.
-static int validate_and_store_implicit_int(parser_t &parser, const argparse_cmd_opts_t &opts,
+static int validate_and_store_implicit_int(parser_t &parser, argparse_cmd_opts_t &opts,
                                            const wchar_t *val, wgetopter_t &w, int long_idx,
                                            io_streams_t &streams) {
     // See if this option passes the validation checks.
-    auto found = opts.options.find(opts.implicit_int_flag);
-    assert(found != opts.options.end());
+    auto found = opts.spec->options.find(opts.spec->implicit_int_flag);
+    assert(found != opts.spec->options.end());
     const auto &opt_spec = found->second;
     int retval = validate_arg(parser, opts, opt_spec.get(), long_idx != -1, val, streams);
     if (retval != STATUS_CMD_OK) return retval;
 
     // It's a valid integer so store it and return success.
-    opt_spec->vals.clear();
-    opt_spec->vals.push_back(wcstring(val));
-    opt_spec->num_seen++;
+    option_result_t &result = opts.result_for(*opt_spec);
+    result.vals.clear();
+    result.vals.push_back(wcstring(val));
+    result.num_seen++;
     w.nextchar = nullptr;
     return STATUS_CMD_OK;
 }
 
-static int handle_flag(parser_t &parser, const argparse_cmd_opts_t &opts, option_spec_t *opt_spec,
+static int handle_flag(parser_t &parser, argparse_cmd_opts_t &opts, const option_spec_t *opt_spec,
                        int long_idx, const wchar_t *woptarg, io_streams_t &streams) {
-    opt_spec->num_seen++;
+    option_result_t &result = opts.result_for(*opt_spec);
+    result.num_seen++;
     if (opt_spec->num_allowed == 0) {
         // It's a boolean flag. Save the flag we saw since it might be useful to know if the
         // short or long flag was given.
         assert(!woptarg);
         if (long_idx == -1) {
-            opt_spec->vals.push_back(wcstring(1, L'-') + opt_spec->short_flag);
+            result.vals.push_back(wcstring(1, L'-') + opt_spec->short_flag);
         } else {
-            opt_spec->vals.push_back(L"--" + opt_spec->long_flag);
+            result.vals.push_back(L"--" + opt_spec->long_flag);
         }
         return STATUS_CMD_OK;
     }
@@ -530,13 +610,13 @@ static int handle_flag(parser_t &parser, const argparse_cmd_opts_t &opts, option
         // We're depending on `wgetopt_long()` to report that a mandatory value is missing if
         // `opt_spec->num_allowed == 1` and thus return ':' so that we don't take this branch if
         // the mandatory arg is missing.
-        opt_spec->vals.clear();
+        result.vals.clear();
         if (woptarg) {
-            opt_spec->vals.push_back(woptarg);
+            result.vals.push_back(woptarg);
         }
     } else {
         assert(woptarg);
-        opt_spec->vals.push_back(woptarg);
+        result.vals.push_back(woptarg);
     }
 
     return STATUS_CMD_OK;
@@ -561,7 +641,7 @@ static int argparse_parse_flags(parser_t &parser, argparse_cmd_opts_t &opts,
             if (is_implicit_int(opts, arg_contents)) {
                 retval = validate_and_store_implicit_int(parser, opts, arg_contents, w, long_idx,
                                                          streams);
-            } else if (!opts.ignore_unknown) {
+            } else if (!opts.spec->ignore_unknown) {
                 streams.err.append_format(BUILTIN_ERR_UNKNOWN, cmd, argv[w.woptind - 1]);
                 retval = STATUS_INVALID_ARGS;
             } else {
@@ -586,8 +666,8 @@ static int argparse_parse_flags(parser_t &parser, argparse_cmd_opts_t &opts,
         }
 
         // It's a recognized flag.
-        auto found = opts.options.find(opt);
-        assert(found != opts.options.end());
+        auto found = opts.spec->options.find(opt);
+        assert(found != opts.spec->options.end());
 
         int retval = handle_flag(parser, opts, found->second.get(), long_idx, w.woptarg, streams);
         if (retval != STATUS_CMD_OK) return retval;
@@ -605,11 +685,8 @@ static int argparse_parse_args(argparse_cmd_opts_t &opts, const wcstring_list_t
                                parser_t &parser, io_streams_t &streams) {
     if (args.empty()) return STATUS_CMD_OK;
 
-    // "+" means stop at nonopt, "-" means give nonoptions the option character code `1`, and don't
-    // reorder.
-    wcstring short_options = opts.stop_nonopt ? L"+:" : L"-:";
-    std::vector<woption> long_options;
-    populate_option_strings(opts, &short_options, &long_options);
+    const wcstring &short_options = opts.spec->short_options;
+    const std::vector<woption> &long_options = opts.spec->long_options;
 
     // long_options should have a "null terminator"
     assert(!long_options.empty() && long_options.back().name == nullptr);
@@ -642,12 +719,14 @@ static int check_min_max_args_constraints(const argparse_cmd_opts_t &opts, const
     UNUSED(parser);
     const wchar_t *cmd = opts.name.c_str();
 
-    if (opts.argv.size() < opts.min_args) {
-        streams.err.append_format(BUILTIN_ERR_MIN_ARG_COUNT1, cmd, opts.min_args, opts.argv.size());
+    const argparse_spec_t &spec = *opts.spec;
+
+    if (opts.argv.size() < spec.min_args) {
+        streams.err.append_format(BUILTIN_ERR_MIN_ARG_COUNT1, cmd, spec.min_args, opts.argv.size());
         return STATUS_CMD_ERROR;
     }
-    if (opts.max_args != SIZE_MAX && opts.argv.size() > opts.max_args) {
-        streams.err.append_format(BUILTIN_ERR_MAX_ARG_COUNT1, cmd, opts.max_args, opts.argv.size());
+    if (spec.max_args != SIZE_MAX && opts.argv.size() > spec.max_args) {
+        streams.err.append_format(BUILTIN_ERR_MAX_ARG_COUNT1, cmd, spec.max_args, opts.argv.size());
         return STATUS_CMD_ERROR;
     }
 
@@ -655,13 +734,14 @@ static int check_min_max_args_constraints(const argparse_cmd_opts_t &opts, const
 }
 
 /// Put the result of parsing the supplied args into the caller environment as local vars.
-static void set_argparse_result_vars(env_stack_t &vars, const argparse_cmd_opts_t &opts) {
-    for (const auto &kv : opts.options) {
+static void set_argparse_result_vars(env_stack_t &vars, argparse_cmd_opts_t &opts) {
+    for (const auto &kv : opts.spec->options) {
         const auto &opt_spec = kv.second;
-        if (!opt_spec->num_seen) continue;
+        const option_result_t &result = opts.result_for(*opt_spec);
+        if (!result.num_seen) continue;
 
         if (opt_spec->short_flag_valid) {
-            vars.set(var_name_prefix + opt_spec->short_flag, ENV_LOCAL, opt_spec->vals);
+            vars.set(var_name_prefix + opt_spec->short_flag, ENV_LOCAL, result.vals);
         }
         if (!opt_spec->long_flag.empty()) {
             // We do a simple replacement of all non alphanum chars rather than calling
@@ -670,7 +750,7 @@ static void set_argparse_result_vars(env_stack_t &vars, const argparse_cmd_opts_
             for (auto &pos : long_flag) {
                 if (!iswalnum(pos)) pos = L'_';
             }
-            vars.set(var_name_prefix + long_flag, ENV_LOCAL, opt_spec->vals);
+            vars.set(var_name_prefix + long_flag, ENV_LOCAL, result.vals);
         }
     }
 
@@ -708,9 +788,7 @@ maybe_t<int> builtin_argparse(parser_t &parser, io_streams_t &streams, wchar_t *
     args.push_back(opts.name);
     while (optind < argc) args.push_back(argv[optind++]);
 
-    retval = parse_exclusive_args(opts, streams);
-    if (retval != STATUS_CMD_OK) return retval;
-
+    opts.results.resize(opts.spec->options.size());
     retval = argparse_parse_args(opts, args, parser, streams);
     if (retval != STATUS_CMD_OK) return retval;
 
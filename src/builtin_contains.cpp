@@ -76,11 +76,10 @@ maybe_t<int> builtin_contains(parser_t &parser, io_streams_t &streams, wchar_t *
     if (!needle) {
         streams.err.append_format(_(L"%ls: Key not specified\n"), cmd);
     } else {
-        for (int i = optind + 1; i < argc; i++) {
-            if (!std::wcscmp(needle, argv[i])) {
-                if (opts.print_index) streams.out.append_format(L"%d\n", i - optind);
-                return STATUS_CMD_OK;
-            }
+        int found_idx;
+        if (builtin_find_args(streams, argv, optind + 1, argc, needle, &found_idx, true)) {
+            if (opts.print_index) streams.out.append_format(L"%d\n", found_idx - optind);
+            return STATUS_CMD_OK;
         }
     }
 
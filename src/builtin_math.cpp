@@ -5,16 +5,20 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <clocale>
 #include <cmath>
 #include <cstddef>
 #include <cstring>
 #include <limits>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "builtin.h"
 #include "common.h"
 #include "fallback.h"  // IWYU pragma: keep
 #include "io.h"
+#include "lru.h"
 #include "tinyexpr.h"
 #include "wgetopt.h"
 #include "wutil.h"  // IWYU pragma: keep
@@ -27,15 +31,23 @@ static constexpr int kDefaultScale = 6;
 static constexpr double kMaximumContiguousInteger =
     double(1LLU << std::numeric_limits<double>::digits);
 
+// How much of stdin to read at once.
+static constexpr size_t kStdinChunkSize = 4096;
+
+// How many compiled expressions to keep around.
+static constexpr size_t kExpressionCacheSize = 64;
+
 struct math_cmd_opts_t {
     bool print_help = false;
+    bool batch = false;
     int scale = kDefaultScale;
 };
 
 // This command is atypical in using the "+" (REQUIRE_ORDER) option for flag parsing.
 // This is needed because of the minus, `-`, operator in math expressions.
-static const wchar_t *const short_options = L"+:hs:";
+static const wchar_t *const short_options = L"+:bhs:";
 static const struct woption long_options[] = {{L"scale", required_argument, nullptr, 's'},
+                                              {L"batch", no_argument, nullptr, 'b'},
                                               {L"help", no_argument, nullptr, 'h'},
                                               {nullptr, 0, nullptr, 0}};
 
@@ -60,6 +72,10 @@ static int parse_cmd_opts(math_cmd_opts_t &opts, int *optind,  //!OCLINT(high nc
                 }
                 break;
             }
+            case 'b': {
+                opts.batch = true;
+                break;
+            }
             case 'h': {
                 opts.print_help = true;
                 break;
@@ -89,44 +105,56 @@ static bool math_args_from_stdin(const io_streams_t &streams) {
     return streams.stdin_is_directly_redirected;
 }
 
-/// Get the arguments from stdin.
-static const wchar_t *math_get_arg_stdin(wcstring *storage, const io_streams_t &streams) {
-    std::string arg;
-    for (;;) {
-        char ch = '\0';
-        long rc = read_blocked(streams.stdin_fd, &ch, 1);
+/// Reads lines from stdin. math always consumes all of its input, so this can read ahead.
+class stdin_line_reader_t {
+    const io_streams_t &streams_;
+    std::string buffer_;
+    // Where the next line starts in buffer_.
+    size_t start_ = 0;
+    // How far from start_ we already know there is no newline.
+    size_t searched_ = 0;
+    bool eof_ = false;
 
-        if (rc < 0) return nullptr;  // failure
+   public:
+    explicit stdin_line_reader_t(const io_streams_t &streams) : streams_(streams) {}
 
-        if (rc == 0) {  // EOF
-            if (arg.empty()) return nullptr;
-            break;
-        }
-
-        if (ch == '\n') break;  // we're done
+    /// Store the next line, without its newline, in \p line. Returns false at the end of input.
+    bool next(wcstring *line) {
+        for (;;) {
+            size_t end = buffer_.find('\n', start_ + searched_);
+            if (end != std::string::npos || eof_) {
+                if (end == std::string::npos) {
+                    if (start_ == buffer_.size()) return false;
+                    end = buffer_.size();
+                }
+                str2wcstring(buffer_.data() + start_, end - start_, line);
+                start_ = std::min(end + 1, buffer_.size());
+                searched_ = 0;
+                return true;
+            }
 
-        arg += ch;
+            buffer_.erase(0, start_);
+            start_ = 0;
+            searched_ = buffer_.size();
+            // Don't hold back output while we wait for input; it might be a while.
+            streams_.out.flush();
+            char chunk[kStdinChunkSize];
+            long rc = read_blocked(streams_.stdin_fd, chunk, sizeof chunk);
+            if (rc < 0) return false;
+            if (rc == 0) {
+                eof_ = true;
+            } else {
+                buffer_.append(chunk, rc);
+            }
+        }
     }
-
-    *storage = str2wcstring(arg);
-    return storage->c_str();
-}
+};
 
 /// Return the next argument from argv.
 static const wchar_t *math_get_arg_argv(int *argidx, wchar_t **argv) {
     return argv && argv[*argidx] ? argv[(*argidx)++] : nullptr;
 }
 
-/// Get the arguments from argv or stdin based on the execution context. This mimics how builtin
-/// `string` does it.
-static const wchar_t *math_get_arg(int *argidx, wchar_t **argv, wcstring *storage,
-                                   const io_streams_t &streams) {
-    if (math_args_from_stdin(streams)) {
-        return math_get_arg_stdin(storage, streams);
-    }
-    return math_get_arg_argv(argidx, argv);
-}
-
 static const wchar_t *math_describe_error(const te_error_t &error) {
     if (error.position == 0) return L"NO ERROR?!?";
 
@@ -166,6 +194,13 @@ static wcstring format_double(double v, const math_cmd_opts_t &opts) {
     }
 
     wcstring ret = format_string(L"%.*f", opts.scale, v);
+    // printf uses the radix character of the current locale, but ours is always ".".
+    const char *radix = localeconv()->decimal_point;
+    if (std::strcmp(radix, ".") != 0) {
+        wcstring wradix = str2wcstring(radix);
+        size_t pos = ret.find(wradix);
+        if (!wradix.empty() && pos != wcstring::npos) ret.replace(pos, wradix.size(), L".");
+    }
     // If we contain a decimal separator, trim trailing zeros after it, and then the separator
     // itself if there's nothing after it. Detect a decimal separator as a non-digit.
     const wchar_t *const digits = L"0123456789";
@@ -184,50 +219,132 @@ static wcstring format_double(double v, const math_cmd_opts_t &opts) {
     return ret;
 }
 
+using shared_te_expr_t = std::shared_ptr<te_expr>;
+
+/// Compiled expressions, keyed by their shape (see te_shape). Scripts tend to evaluate the same
+/// few expressions with different numbers, like `math $i + 1` in a loop, and those share an entry.
+class expression_cache_t : public lru_cache_t<expression_cache_t, shared_te_expr_t> {
+   public:
+    expression_cache_t()
+        : lru_cache_t<expression_cache_t, shared_te_expr_t>(kExpressionCacheSize) {}
+};
+static owning_lock<expression_cache_t> s_expression_cache;
+
+/// Compile \p expression, or get it from the cache. On success, \p literals holds the values to
+/// evaluate it with. On failure, returns null and sets \p error.
+static shared_te_expr_t compile_expression(const wcstring &expression, te_literals_t *literals,
+                                           te_error_t *error) {
+    std::string narrow = wcs2string(expression);
+    std::string shape;
+    if (!te_shape(narrow.c_str(), &shape, literals)) {
+        // Let the parser figure out what exactly is wrong.
+        te_free(te_compile(narrow.c_str(), error));
+        return nullptr;
+    }
+
+    wcstring key(shape.begin(), shape.end());
+    {
+        auto cache = s_expression_cache.acquire();
+        if (shared_te_expr_t *cached = cache->get(key)) {
+            error->position = 0;
+            return *cached;
+        }
+    }
+
+    shared_te_expr_t compiled(te_compile(narrow.c_str(), error), te_free);
+    if (compiled) {
+        s_expression_cache.acquire()->insert(std::move(key), compiled);
+    }
+    return compiled;
+}
+
+/// Print an error about \p expression failing to compile.
+static void report_compile_error(const wchar_t *cmd, io_streams_t &streams,
+                                 const wcstring &expression, const te_error_t &error) {
+    streams.err.append_format(L"%ls: Error: %ls\n", cmd, math_describe_error(error));
+    streams.err.append_format(L"'%ls'\n", expression.c_str());
+    streams.err.append_format(L"%*ls%ls\n", error.position - 1, L" ", L"^");
+}
+
+/// Print the value \p v that \p expression evaluated to, or an error if it isn't a usable number.
+static int report_result(const wchar_t *cmd, io_streams_t &streams, const math_cmd_opts_t &opts,
+                         const wcstring &expression, double v) {
+    // Check some runtime errors after the fact.
+    // TODO: Really, this should be done in tinyexpr
+    // (e.g. infinite is the result of "x / 0"),
+    // but that's much more work.
+    const char *error_message = nullptr;
+    if (std::isinf(v)) {
+        error_message = "Result is infinite";
+    } else if (std::isnan(v)) {
+        error_message = "Result is not a number";
+    } else if (std::abs(v) >= kMaximumContiguousInteger) {
+        error_message = "Result magnitude is too large";
+    }
+    if (error_message) {
+        streams.err.append_format(L"%ls: Error: %s\n", cmd, error_message);
+        streams.err.append_format(L"'%ls'\n", expression.c_str());
+        return STATUS_CMD_ERROR;
+    }
+    streams.out.append(format_double(v, opts));
+    streams.out.push_back(L'\n');
+    return STATUS_CMD_OK;
+}
+
 /// Evaluate math expressions.
-static int evaluate_expression(const wchar_t *cmd, const parser_t &parser, io_streams_t &streams,
-                               const math_cmd_opts_t &opts, wcstring &expression) {
-    UNUSED(parser);
+static int evaluate_expression(const wchar_t *cmd, io_streams_t &streams,
+                               const math_cmd_opts_t &opts, const wcstring &expression) {
+    te_error_t error;
+    te_literals_t literals;
+    shared_te_expr_t compiled = compile_expression(expression, &literals, &error);
+    if (!compiled) {
+        report_compile_error(cmd, streams, expression, error);
+        return STATUS_CMD_ERROR;
+    }
+    if (!literals.placeholders.empty()) {
+        streams.err.append_format(_(L"%ls: Error: '{}' can only be used with --batch\n"), cmd);
+        streams.err.append_format(L"'%ls'\n", expression.c_str());
+        return STATUS_CMD_ERROR;
+    }
+    return report_result(cmd, streams, opts, expression,
+                         te_eval(compiled.get(), literals.values.data()));
+}
 
-    int retval = STATUS_CMD_OK;
+/// Evaluate \p expression once for every line of stdin, with "{}" standing for the line's value.
+static int evaluate_batch(const wchar_t *cmd, io_streams_t &streams, const math_cmd_opts_t &opts,
+                          const wcstring &expression) {
     te_error_t error;
-    std::string narrow_str = wcs2string(expression);
-    // Switch locale while computing stuff.
-    // This means that the "." is always the radix character,
-    // so numbers work the same across locales.
-    char *saved_locale = strdup(setlocale(LC_NUMERIC, nullptr));
-    setlocale(LC_NUMERIC, "C");
-    double v = te_interp(narrow_str.c_str(), &error);
-
-    if (error.position == 0) {
-        // Check some runtime errors after the fact.
-        // TODO: Really, this should be done in tinyexpr
-        // (e.g. infinite is the result of "x / 0"),
-        // but that's much more work.
-        const char *error_message = nullptr;
-        if (std::isinf(v)) {
-            error_message = "Result is infinite";
-        } else if (std::isnan(v)) {
-            error_message = "Result is not a number";
-        } else if (std::abs(v) >= kMaximumContiguousInteger) {
-            error_message = "Result magnitude is too large";
+    te_literals_t literals;
+    shared_te_expr_t compiled = compile_expression(expression, &literals, &error);
+    if (!compiled) {
+        report_compile_error(cmd, streams, expression, error);
+        return STATUS_CMD_ERROR;
+    }
+
+    int retval = STATUS_CMD_OK;
+    stdin_line_reader_t reader(streams);
+    wcstring line;
+    while (reader.next(&line)) {
+        const wchar_t *start = line.c_str();
+        while (iswspace(*start)) start++;
+        wchar_t *end = nullptr;
+        double value = fish_wcstod(start, &end);
+        while (end && iswspace(*end)) end++;
+        if (end == start || *end != L'\0') {
+            streams.err.append_format(_(L"%ls: '%ls' is not a valid number\n"), cmd,
+                                      line.c_str());
+            retval = STATUS_CMD_ERROR;
+            continue;
+        }
+
+        for (size_t idx : literals.placeholders) {
+            literals.values[idx] = value;
         }
-        if (error_message) {
-            streams.err.append_format(L"%ls: Error: %s\n", cmd, error_message);
-            streams.err.append_format(L"'%ls'\n", expression.c_str());
+        if (report_result(cmd, streams, opts, expression,
+                          te_eval(compiled.get(), literals.values.data())) != STATUS_CMD_OK) {
             retval = STATUS_CMD_ERROR;
-        } else {
-            streams.out.append(format_double(v, opts));
-            streams.out.push_back(L'\n');
         }
-    } else {
-        streams.err.append_format(L"%ls: Error: %ls\n", cmd, math_describe_error(error));
-        streams.err.append_format(L"'%ls'\n", expression.c_str());
-        streams.err.append_format(L"%*ls%ls\n", error.position - 1, L" ", L"^");
-        retval = STATUS_CMD_ERROR;
     }
-    setlocale(LC_NUMERIC, saved_locale);
-    free(saved_locale);
     return retval;
 }
 
@@ -249,16 +366,33 @@ maybe_t<int> builtin_math(parser_t &parser, io_streams_t &streams, wchar_t **arg
         return STATUS_CMD_OK;
     }
 
+    if (opts.batch && !math_args_from_stdin(streams)) {
+        streams.err.append_format(_(L"%ls: --batch reads its input from stdin\n"), cmd);
+        return STATUS_INVALID_ARGS;
+    }
+
+    // In batch mode, the expression comes from the arguments and the values from stdin.
     wcstring expression;
-    wcstring storage;
-    while (const wchar_t *arg = math_get_arg(&optind, argv, &storage, streams)) {
-        if (!expression.empty()) expression.push_back(L' ');
-        expression.append(arg);
+    if (math_args_from_stdin(streams) && !opts.batch) {
+        stdin_line_reader_t reader(streams);
+        wcstring line;
+        while (reader.next(&line)) {
+            if (!expression.empty()) expression.push_back(L' ');
+            expression.append(line);
+        }
+    } else {
+        while (const wchar_t *arg = math_get_arg_argv(&optind, argv)) {
+            if (!expression.empty()) expression.push_back(L' ');
+            expression.append(arg);
+        }
     }
 
     if (expression.empty()) {
         streams.err.append_format(BUILTIN_ERR_MIN_ARG_COUNT1, L"math", 1, 0);
         return STATUS_CMD_ERROR;
     }
-    return evaluate_expression(cmd, parser, streams, opts, expression);
+    if (opts.batch) {
+        return evaluate_batch(cmd, streams, opts, expression);
+    }
+    return evaluate_expression(cmd, streams, opts, expression);
 }
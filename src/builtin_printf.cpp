@@ -62,6 +62,7 @@
 #include <cstring>
 #include <cwchar>
 #include <cwctype>
+#include <vector>
 
 #include "builtin.h"
 #include "common.h"
@@ -71,6 +72,44 @@
 
 class parser_t;
 
+// How much output we collect before handing it to the output stream.
+static constexpr size_t kPrintfFlushSize = 16 * 1024;
+
+/// One step of a compiled format string. The format is compiled once and the result is used for
+/// every cycle through the arguments.
+struct format_directive_t {
+    enum kind_t {
+        // Output text verbatim. Simple escapes are already decoded.
+        literal,
+        // An escape which can fail or stop output, like \c. It's in text, starting at the
+        // backslash, and evaluated whenever it is reached.
+        escape,
+        // %b, which prints its argument with escapes interpreted.
+        escaped_argument,
+        // A conversion. text is the format for append_format, including the length modifier.
+        spec,
+        // An invalid conversion, which is in text. Reaching it is a fatal error.
+        invalid,
+    };
+    kind_t kind;
+    wcstring text;
+    wchar_t conversion;
+    // Whether the field width and precision are given as '*', i.e. consume an argument.
+    bool star_width;
+    bool star_precision;
+    // Whether there are no flags, field width or precision, i.e. the value can be printed as is.
+    bool plain;
+
+    format_directive_t(kind_t kind, wcstring text)
+        : kind(kind),
+          text(std::move(text)),
+          conversion(L'\0'),
+          star_width(false),
+          star_precision(false),
+          plain(false) {}
+};
+using format_plan_t = std::vector<format_directive_t>;
+
 struct builtin_printf_state_t {
     // Out and err streams. Note this is a captured reference!
     io_streams_t &streams;
@@ -82,15 +121,19 @@ struct builtin_printf_state_t {
     // \c escape.
     bool early_exit;
 
+    // Output that hasn't been passed to streams.out yet. Reused so formatting doesn't allocate.
+    wcstring buffer;
+
     explicit builtin_printf_state_t(io_streams_t &s)
         : streams(s), exit_code(0), early_exit(false) {}
 
     void verify_numeric(const wchar_t *s, const wchar_t *end, int errcode);
 
-    void print_direc(const wchar_t *start, size_t length, wchar_t conversion, bool have_field_width,
-                     int field_width, bool have_precision, int precision, wchar_t const *argument);
+    void print_direc(const format_directive_t &direc, int field_width, int precision,
+                     wchar_t const *argument);
 
-    int print_formatted(const wchar_t *format, int argc, wchar_t **argv);
+    format_plan_t compile_format(const wchar_t *format);
+    int print_formatted(const format_plan_t &plan, int argc, wchar_t **argv);
 
     void nonfatal_error(const wchar_t *fmt, ...);
     void fatal_error(const wchar_t *fmt, ...);
@@ -102,6 +145,7 @@ struct builtin_printf_state_t {
     void append_output(wchar_t c);
     void append_output(const wchar_t *c);
     void append_format_output(const wchar_t *fmt, ...);
+    void flush_output();
 };
 
 static bool is_octal_digit(wchar_t c) { return iswdigit(c) && c < L'8'; }
@@ -204,6 +248,8 @@ void builtin_printf_state_t::nonfatal_error(const wchar_t *fmt, ...) {
     // Don't error twice.
     if (early_exit) return;
 
+    // Keep the output in order with the error.
+    flush_output();
     va_list va;
     va_start(va, fmt);
     wcstring errstr = vformat_string(fmt, va);
@@ -220,6 +266,7 @@ void builtin_printf_state_t::fatal_error(const wchar_t *fmt, ...) {
     // Don't error twice.
     if (early_exit) return;
 
+    flush_output();
     va_list va;
     va_start(va, fmt);
     wcstring errstr = vformat_string(fmt, va);
@@ -234,14 +281,16 @@ void builtin_printf_state_t::append_output(wchar_t c) {
     // Don't output if we're done.
     if (early_exit) return;
 
-    streams.out.push_back(c);
+    buffer.push_back(c);
+    if (buffer.size() >= kPrintfFlushSize) flush_output();
 }
 
 void builtin_printf_state_t::append_output(const wchar_t *c) {
     // Don't output if we're done.
     if (early_exit) return;
 
-    streams.out.append(c);
+    buffer.append(c);
+    if (buffer.size() >= kPrintfFlushSize) flush_output();
 }
 
 void builtin_printf_state_t::append_format_output(const wchar_t *fmt, ...) {
@@ -250,9 +299,15 @@ void builtin_printf_state_t::append_format_output(const wchar_t *fmt, ...) {
 
     va_list va;
     va_start(va, fmt);
-    wcstring tmp = vformat_string(fmt, va);
+    append_formatv(buffer, fmt, va);
     va_end(va);
-    streams.out.append(tmp);
+    if (buffer.size() >= kPrintfFlushSize) flush_output();
+}
+
+void builtin_printf_state_t::flush_output() {
+    if (buffer.empty()) return;
+    streams.out.append(buffer);
+    buffer.clear();
 }
 
 void builtin_printf_state_t::verify_numeric(const wchar_t *s, const wchar_t *end, int errcode) {
@@ -437,68 +492,35 @@ void builtin_printf_state_t::print_esc_string(const wchar_t *str) {
             this->append_output(*str);
 }
 
-/// Evaluate a printf conversion specification.  START is the start of the directive, LENGTH is its
-/// length, and CONVERSION specifies the type of conversion.  LENGTH does not include any length
-/// modifier or the conversion specifier itself.  FIELD_WIDTH and PRECISION are the field width and
-/// precision for '*' values, if HAVE_FIELD_WIDTH and HAVE_PRECISION are true, respectively.
-/// ARGUMENT is the argument to be formatted.
-void builtin_printf_state_t::print_direc(const wchar_t *start, size_t length, wchar_t conversion,
-                                         bool have_field_width, int field_width,
-                                         bool have_precision, int precision,
-                                         wchar_t const *argument) {
-    // Start with everything except the conversion specifier.
-    wcstring fmt(start, length);
-
-    // Create a copy of the % directive, with an intmax_t-wide width modifier substituted for any
-    // existing integer length modifier.
-    switch (conversion) {
-        case L'x':
-        case L'X':
-        case L'd':
-        case L'i':
-        case L'o':
-        case L'u': {
-            fmt.append(L"ll");
-            break;
-        }
-        case L'a':
-        case L'e':
-        case L'f':
-        case L'g':
-        case L'A':
-        case L'E':
-        case L'F':
-        case L'G': {
-            fmt.append(L"L");
-            break;
-        }
-        case L's':
-        case L'c': {
-            fmt.append(L"l");
-            break;
-        }
-        default: {
-            break;
-        }
+/// Evaluate a printf conversion \p direc. \p field_width and \p precision are the values for '*',
+/// if the directive has them. \p argument is the argument to be formatted.
+void builtin_printf_state_t::print_direc(const format_directive_t &direc, int field_width,
+                                         int precision, wchar_t const *argument) {
+    const wchar_t *fmt = direc.text.c_str();
+    const wchar_t conversion = direc.conversion;
+    const bool have_field_width = direc.star_width;
+    const bool have_precision = direc.star_precision;
+
+    // The most common case by far, which needs no formatting at all.
+    if (conversion == L's' && direc.plain) {
+        this->append_output(argument);
+        return;
     }
 
-    // Append the conversion itself.
-    fmt.push_back(conversion);
-
     switch (conversion) {
         case L'd':
         case L'i': {
             auto arg = string_to_scalar_type<intmax_t>(argument, this);
             if (!have_field_width) {
                 if (!have_precision)
-                    this->append_format_output(fmt.c_str(), arg);
+                    this->append_format_output(fmt, arg);
                 else
-                    this->append_format_output(fmt.c_str(), precision, arg);
+                    this->append_format_output(fmt, precision, arg);
             } else {
                 if (!have_precision)
-                    this->append_format_output(fmt.c_str(), field_width, arg);
+                    this->append_format_output(fmt, field_width, arg);
                 else
-                    this->append_format_output(fmt.c_str(), field_width, precision, arg);
+                    this->append_format_output(fmt, field_width, precision, arg);
             }
             break;
         }
@@ -509,14 +531,14 @@ void builtin_printf_state_t::print_direc(const wchar_t *start, size_t length, wc
             auto arg = string_to_scalar_type<uintmax_t>(argument, this);
             if (!have_field_width) {
                 if (!have_precision)
-                    this->append_format_output(fmt.c_str(), arg);
+                    this->append_format_output(fmt, arg);
                 else
-                    this->append_format_output(fmt.c_str(), precision, arg);
+                    this->append_format_output(fmt, precision, arg);
             } else {
                 if (!have_precision)
-                    this->append_format_output(fmt.c_str(), field_width, arg);
+                    this->append_format_output(fmt, field_width, arg);
                 else
-                    this->append_format_output(fmt.c_str(), field_width, precision, arg);
+                    this->append_format_output(fmt, field_width, precision, arg);
             }
             break;
         }
@@ -531,39 +553,39 @@ void builtin_printf_state_t::print_direc(const wchar_t *start, size_t length, wc
             auto arg = string_to_scalar_type<long double>(argument, this);
             if (!have_field_width) {
                 if (!have_precision) {
-                    this->append_format_output(fmt.c_str(), arg);
+                    this->append_format_output(fmt, arg);
                 } else {
-                    this->append_format_output(fmt.c_str(), precision, arg);
+                    this->append_format_output(fmt, precision, arg);
                 }
             } else {
                 if (!have_precision) {
-                    this->append_format_output(fmt.c_str(), field_width, arg);
+                    this->append_format_output(fmt, field_width, arg);
                 } else {
-                    this->append_format_output(fmt.c_str(), field_width, precision, arg);
+                    this->append_format_output(fmt, field_width, precision, arg);
                 }
             }
             break;
         }
         case L'c': {
             if (!have_field_width) {
-                this->append_format_output(fmt.c_str(), *argument);
+                this->append_format_output(fmt, *argument);
             } else {
-                this->append_format_output(fmt.c_str(), field_width, *argument);
+                this->append_format_output(fmt, field_width, *argument);
             }
             break;
         }
         case L's': {
             if (!have_field_width) {
                 if (!have_precision) {
-                    this->append_format_output(fmt.c_str(), argument);
+                    this->append_format_output(fmt, argument);
                 } else {
-                    this->append_format_output(fmt.c_str(), precision, argument);
+                    this->append_format_output(fmt, precision, argument);
                 }
             } else {
                 if (!have_precision) {
-                    this->append_format_output(fmt.c_str(), field_width, argument);
+                    this->append_format_output(fmt, field_width, argument);
                 } else {
-                    this->append_format_output(fmt.c_str(), field_width, precision, argument);
+                    this->append_format_output(fmt, field_width, precision, argument);
                 }
             }
             break;
@@ -583,40 +605,55 @@ static inline void modify_allowed_format_specifiers(bool ok[UCHAR_MAX + 1], cons
     }
 }
 
-/// Print the text in FORMAT, using ARGV (with ARGC elements) for arguments to any `%' directives.
-/// Return the number of elements of ARGV used.
-int builtin_printf_state_t::print_formatted(const wchar_t *format, int argc, wchar_t **argv) {
-    int save_argc = argc;        /* Preserve original value.  */
-    const wchar_t *f;            /* Pointer into `format'.  */
-    const wchar_t *direc_start;  /* Start of % directive.  */
-    size_t direc_length;         /* Length of % directive.  */
-    bool have_field_width;       /* True if FIELD_WIDTH is valid.  */
-    int field_width = 0;         /* Arg to first '*'.  */
-    bool have_precision;         /* True if PRECISION is valid.  */
-    int precision = 0;           /* Arg to second '*'.  */
+/// Return whether the escape at \p escstart always produces the same output without error, so it
+/// can be decoded when compiling the format.
+static bool is_static_escape(const wchar_t *escstart) {
+    const wchar_t *p = escstart + 1;
+    switch (*p) {
+        case L'c':
+        case L'U': {
+            return false;
+        }
+        case L'x':
+        case L'u': {
+            return iswxdigit(p[1]);
+        }
+        default: {
+            return true;
+        }
+    }
+}
+
+/// Compile FORMAT into the list of directives that print_formatted executes.
+format_plan_t builtin_printf_state_t::compile_format(const wchar_t *format) {
+    format_plan_t plan;
     bool ok[UCHAR_MAX + 1] = {}; /* ok['x'] is true if %x is allowed.  */
 
-    for (f = format; *f != L'\0'; ++f) {
+    // Append to the trailing literal, creating it if necessary.
+    auto literal = [&]() -> wcstring & {
+        if (plan.empty() || plan.back().kind != format_directive_t::literal) {
+            plan.emplace_back(format_directive_t::literal, wcstring{});
+        }
+        return plan.back().text;
+    };
+
+    for (const wchar_t *f = format; *f != L'\0'; ++f) {
         switch (*f) {
             case L'%': {
-                direc_start = f++;
-                direc_length = 1;
-                have_field_width = have_precision = false;
+                const wchar_t *direc_start = f++;
+                size_t direc_length = 1;
                 if (*f == L'%') {
-                    this->append_output(L'%');
+                    literal().push_back(L'%');
                     break;
                 }
                 if (*f == L'b') {
                     // FIXME: Field width and precision are not supported for %b, even though POSIX
                     // requires it.
-                    if (argc > 0) {
-                        print_esc_string(*argv);
-                        ++argv;
-                        --argc;
-                    }
+                    plan.emplace_back(format_directive_t::escaped_argument, wcstring{});
                     break;
                 }
 
+                format_directive_t direc(format_directive_t::spec, wcstring{});
                 modify_allowed_format_specifiers(ok, "aAcdeEfFgGiosuxX", true);
                 for (bool continue_looking_for_flags = true; continue_looking_for_flags;) {
                     switch (*f) {
@@ -652,18 +689,7 @@ int builtin_printf_state_t::print_formatted(const wchar_t *format, int argc, wch
                 if (*f == L'*') {
                     ++f;
                     ++direc_length;
-                    if (argc > 0) {
-                        auto width = string_to_scalar_type<intmax_t>(*argv, this);
-                        if (INT_MIN <= width && width <= INT_MAX)
-                            field_width = static_cast<int>(width);
-                        else
-                            this->fatal_error(_(L"invalid field width: %ls"), *argv);
-                        ++argv;
-                        --argc;
-                    } else {
-                        field_width = 0;
-                    }
-                    have_field_width = true;
+                    direc.star_width = true;
                 } else {
                     while (iswdigit(*f)) {
                         ++f;
@@ -677,23 +703,7 @@ int builtin_printf_state_t::print_formatted(const wchar_t *format, int argc, wch
                     if (*f == L'*') {
                         ++f;
                         ++direc_length;
-                        if (argc > 0) {
-                            auto prec = string_to_scalar_type<intmax_t>(*argv, this);
-                            if (prec < 0) {
-                                // A negative precision is taken as if the precision were omitted,
-                                // so -1 is safe here even if prec < INT_MIN.
-                                precision = -1;
-                            } else if (INT_MAX < prec)
-                                this->fatal_error(_(L"invalid precision: %ls"), *argv);
-                            else {
-                                precision = static_cast<int>(prec);
-                            }
-                            ++argv;
-                            --argc;
-                        } else {
-                            precision = 0;
-                        }
-                        have_precision = true;
+                        direc.star_precision = true;
                     } else {
                         while (iswdigit(*f)) {
                             ++f;
@@ -709,26 +719,141 @@ int builtin_printf_state_t::print_formatted(const wchar_t *format, int argc, wch
 
                 wchar_t conversion = *f;
                 if (conversion > 0xFF || !ok[conversion]) {
-                    this->fatal_error(_(L"%.*ls: invalid conversion specification"),
-                                      static_cast<int>(f + 1 - direc_start), direc_start);
-                    return 0;
+                    // Nothing after this is ever printed.
+                    plan.emplace_back(format_directive_t::invalid,
+                                      wcstring(direc_start, f + 1 - direc_start));
+                    return plan;
                 }
 
-                const wchar_t *argument = L"";
-                if (argc > 0) {
-                    argument = *argv++;
-                    argc--;
+                // Create a copy of the % directive, with an intmax_t-wide width modifier
+                // substituted for any existing integer length modifier.
+                direc.text.assign(direc_start, direc_length);
+                switch (conversion) {
+                    case L'x':
+                    case L'X':
+                    case L'd':
+                    case L'i':
+                    case L'o':
+                    case L'u': {
+                        direc.text.append(L"ll");
+                        break;
+                    }
+                    case L'a':
+                    case L'e':
+                    case L'f':
+                    case L'g':
+                    case L'A':
+                    case L'E':
+                    case L'F':
+                    case L'G': {
+                        direc.text.append(L"L");
+                        break;
+                    }
+                    case L's':
+                    case L'c': {
+                        direc.text.append(L"l");
+                        break;
+                    }
+                    default: {
+                        break;
+                    }
                 }
-                print_direc(direc_start, direc_length, *f, have_field_width, field_width,
-                            have_precision, precision, argument);
+                direc.text.push_back(conversion);
+                direc.conversion = conversion;
+                direc.plain = direc_length == 1;
+                plan.push_back(std::move(direc));
                 break;
             }
             case L'\\': {
-                f += print_esc(f, false);
+                if (is_static_escape(f)) {
+                    // Decode it through the usual output path, and move the result into the plan.
+                    flush_output();
+                    f += print_esc(f, false);
+                    literal().append(buffer);
+                    buffer.clear();
+                } else {
+                    // Take the backslash, the escape character and for \U up to 8 hex digits.
+                    const wchar_t *escstart = f;
+                    f += 2;
+                    if (escstart[1] == L'U') {
+                        while (iswxdigit(*f) && f - escstart < 10) f++;
+                    }
+                    plan.emplace_back(format_directive_t::escape, wcstring(escstart, f));
+                    f--;
+                }
                 break;
             }
             default: {
-                this->append_output(*f);
+                literal().push_back(*f);
+                break;
+            }
+        }
+    }
+    return plan;
+}
+
+/// Print PLAN, using ARGV (with ARGC elements) for arguments to any `%' directives.
+/// Return the number of elements of ARGV used.
+int builtin_printf_state_t::print_formatted(const format_plan_t &plan, int argc, wchar_t **argv) {
+    int save_argc = argc; /* Preserve original value.  */
+
+    for (const format_directive_t &direc : plan) {
+        if (early_exit) break;
+        switch (direc.kind) {
+            case format_directive_t::literal: {
+                this->append_output(direc.text.c_str());
+                break;
+            }
+            case format_directive_t::escape: {
+                print_esc(direc.text.c_str(), false);
+                break;
+            }
+            case format_directive_t::escaped_argument: {
+                if (argc > 0) {
+                    print_esc_string(*argv);
+                    ++argv;
+                    --argc;
+                }
+                break;
+            }
+            case format_directive_t::invalid: {
+                this->fatal_error(_(L"%ls: invalid conversion specification"),
+                                  direc.text.c_str());
+                return 0;
+            }
+            case format_directive_t::spec: {
+                int field_width = 0; /* Arg to first '*'.  */
+                int precision = 0;   /* Arg to second '*'.  */
+                if (direc.star_width && argc > 0) {
+                    auto width = string_to_scalar_type<intmax_t>(*argv, this);
+                    if (INT_MIN <= width && width <= INT_MAX)
+                        field_width = static_cast<int>(width);
+                    else
+                        this->fatal_error(_(L"invalid field width: %ls"), *argv);
+                    ++argv;
+                    --argc;
+                }
+                if (direc.star_precision && argc > 0) {
+                    auto prec = string_to_scalar_type<intmax_t>(*argv, this);
+                    if (prec < 0) {
+                        // A negative precision is taken as if the precision were omitted,
+                        // so -1 is safe here even if prec < INT_MIN.
+                        precision = -1;
+                    } else if (INT_MAX < prec)
+                        this->fatal_error(_(L"invalid precision: %ls"), *argv);
+                    else {
+                        precision = static_cast<int>(prec);
+                    }
+                    ++argv;
+                    --argc;
+                }
+
+                const wchar_t *argument = L"";
+                if (argc > 0) {
+                    argument = *argv++;
+                    argc--;
+                }
+                print_direc(direc, field_width, precision, argument);
                 break;
             }
         }
@@ -759,14 +884,15 @@ maybe_t<int> builtin_printf(parser_t &parser, io_streams_t &streams, wchar_t **a
 
     builtin_printf_state_t state(streams);
     int args_used;
-    wchar_t *format = argv[0];
+    format_plan_t plan = state.compile_format(argv[0]);
     argc--;
     argv++;
 
     do {
-        args_used = state.print_formatted(format, argc, argv);
+        args_used = state.print_formatted(plan, argc, argv);
         argc -= args_used;
         argv += args_used;
     } while (args_used > 0 && argc > 0 && !state.early_exit);
+    state.flush_output();
     return state.exit_code;
 }
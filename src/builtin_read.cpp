@@ -3,6 +3,8 @@
 
 #include "builtin_read.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -349,6 +351,104 @@ static int read_one_char_at_a_time(int fd, wcstring &buff, int nchars, bool spli
     return exit_res;
 }
 
+#if HAVE_TEE
+/// How much of a pipe's contents we look at at once.
+static constexpr size_t kPipePeekSize = 64 * 1024;
+
+/// Read exactly \p count bytes from \p fd into \p buff, unless EOF or an error comes first.
+/// \return the number of bytes read.
+static size_t read_exactly(int fd, char *buff, size_t count) {
+    size_t total = 0;
+    while (total < count) {
+        long amt = read_blocked(fd, buff + total, count - total);
+        if (amt <= 0) break;
+        total += amt;
+    }
+    return total;
+}
+
+/// Read from the pipe \p fd until a newline or null, as requested, is seen, consuming nothing of
+/// the pipe past it. The pipe's contents are first copied with tee(), which leaves them in the pipe;
+/// then exactly the bytes up to the terminator are read. The copy is kept in the parser, so a loop
+/// of `read` on the same pipe needs about one read() per line instead of one per byte.
+///
+/// Returns an exit status, or none() if the fd cannot be read this way (e.g. it is not a pipe).
+static maybe_t<int> read_from_pipe(parser_t &parser, int fd, wcstring &buff, bool split_null) {
+    struct stat buf;
+    if (fstat(fd, &buf) != 0 || !S_ISFIFO(buf.st_mode)) return none();
+
+    pipe_peek_t &peek = parser.libdata().read_peek;
+    if (!peek.is_valid_for(buf.st_dev, buf.st_ino)) {
+        peek.invalidate();
+        peek.dev = buf.st_dev;
+        peek.ino = buf.st_ino;
+    }
+    if (!peek.scratch) {
+        peek.scratch = make_autoclose_pipes({});
+        if (!peek.scratch) return none();
+    }
+
+    const char terminator = split_null ? '\0' : '\n';
+    int exit_res = STATUS_CMD_OK;
+    std::string str;
+    bool eof = false;
+    bool finished = false;
+    while (!finished) {
+        if (peek.consumed == peek.bytes.size()) {
+            // Copy what the pipe holds. Like read(), this waits until there is something.
+            peek.invalidate();
+            ssize_t amt;
+            do {
+                amt = tee(fd, peek.scratch->write.fd(), kPipePeekSize, 0);
+            } while (amt < 0 && errno == EINTR);
+            if (amt < 0 && str.empty()) return none();
+            if (amt <= 0) {
+                eof = true;
+                break;
+            }
+            peek.bytes.resize(amt);
+            peek.bytes.resize(read_exactly(peek.scratch->read.fd(), &peek.bytes[0], amt));
+        }
+
+        // Consume the bytes up to and including the terminator, or all we have if there is none.
+        const char *start = peek.bytes.data() + peek.consumed;
+        size_t avail = peek.bytes.size() - peek.consumed;
+        const char *term = static_cast<const char *>(std::memchr(start, terminator, avail));
+        size_t want = term ? term - start + 1 : avail;
+        size_t old_size = str.size();
+        str.resize(old_size + want);
+        size_t got = read_exactly(fd, &str[old_size], want);
+        str.resize(old_size + got);
+        if (got == 0) {
+            eof = true;
+            break;
+        }
+
+        if (got == want && std::memcmp(&str[old_size], start, want) == 0) {
+            peek.consumed += want;
+            finished = term != nullptr;
+        } else {
+            // Something else read from the pipe since we looked. What we just read is still what
+            // came next in the pipe, so use it.
+            peek.invalidate();
+            finished = std::memchr(&str[old_size], terminator, got) != nullptr;
+        }
+
+        if (str.size() > read_byte_limit) {
+            exit_res = STATUS_READ_TOO_MUCH;
+            break;
+        }
+    }
+
+    if (finished) str.resize(str.find(terminator));
+    buff = str2wcstring(str);
+    if (buff.empty() && eof) {
+        exit_res = STATUS_CMD_ERROR;
+    }
+    return exit_res;
+}
+#endif
+
 /// Validate the arguments given to `read` and provide defaults where needed.
 static int validate_read_args(const wchar_t *cmd, read_cmd_opts_t &opts, int argc,
                               const wchar_t *const *argv, parser_t &parser, io_streams_t &streams) {
@@ -492,8 +592,20 @@ maybe_t<int> builtin_read(parser_t &parser, io_streams_t &streams, wchar_t **arg
                    lseek(streams.stdin_fd, 0, SEEK_CUR) != -1) {
             exit_res = read_in_chunks(streams.stdin_fd, buff, opts.split_null);
         } else {
-            exit_res =
-                read_one_char_at_a_time(streams.stdin_fd, buff, opts.nchars, opts.split_null);
+            maybe_t<int> pipe_res{};
+#if HAVE_TEE
+            if (!opts.nchars && !stream_stdin_is_a_tty) {
+                pipe_res = read_from_pipe(parser, streams.stdin_fd, buff, opts.split_null);
+            }
+#endif
+            if (pipe_res) {
+                exit_res = *pipe_res;
+            } else {
+                // This consumes input behind the back of anything read_from_pipe() has looked at.
+                parser.libdata().read_peek.invalidate();
+                exit_res =
+                    read_one_char_at_a_time(streams.stdin_fd, buff, opts.nchars, opts.split_null);
+            }
         }
 
         if (exit_res != STATUS_CMD_OK) {
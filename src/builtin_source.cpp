@@ -9,6 +9,7 @@
 
 #include <cwchar>
 
+#include "autoload.h"
 #include "builtin.h"
 #include "common.h"
 #include "env.h"
@@ -46,6 +47,9 @@ maybe_t<int> builtin_source(parser_t &parser, io_streams_t &streams, wchar_t **a
     struct stat buf;
     const wchar_t *fn, *fn_intern;
 
+    // The file's contents, if they were read and parsed ahead of time.
+    parsed_source_ref_t preloaded;
+
     if (argc == optind || std::wcscmp(argv[optind], L"-") == 0) {
         // Either a bare `source` which means to implicitly read from stdin or an explicit `-`.
         if (argc == optind && isatty(streams.stdin_fd)) {
@@ -78,6 +82,7 @@ maybe_t<int> builtin_source(parser_t &parser, io_streams_t &streams, wchar_t **a
         }
 
         fn_intern = intern(argv[optind]);
+        preloaded = autoload_take_preloaded(argv[optind], file_id_t::from_stat(buf));
     }
     assert(fd >= 0 && "Should have a valid fd");
 
@@ -91,7 +96,8 @@ maybe_t<int> builtin_source(parser_t &parser, io_streams_t &streams, wchar_t **a
         null_terminated_array_t<wchar_t>::to_list(argv + optind + (argc == optind ? 0 : 1));
     parser.vars().set_argv(std::move(argv_list));
 
-    retval = reader_read(parser, fd, streams.io_chain ? *streams.io_chain : io_chain_t());
+    const io_chain_t &io = streams.io_chain ? *streams.io_chain : io_chain_t();
+    retval = preloaded ? reader_read_parsed(parser, preloaded, io) : reader_read(parser, fd, io);
 
     parser.pop_block(sb);
 
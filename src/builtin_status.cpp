@@ -13,6 +13,7 @@
 #include "future_feature_flags.h"
 #include "io.h"
 #include "parser.h"
+#include "perf_counters.h"
 #include "proc.h"
 #include "wgetopt.h"
 #include "wutil.h"  // IWYU pragma: keep
@@ -34,6 +35,7 @@ enum status_cmd_t {
     STATUS_IS_LOGIN,
     STATUS_IS_NO_JOB_CTRL,
     STATUS_LINE_NUMBER,
+    STATUS_PERF,
     STATUS_SET_JOB_CONTROL,
     STATUS_STACK_TRACE,
     STATUS_TEST_FEATURE,
@@ -64,6 +66,7 @@ const enum_map<status_cmd_t> status_enum_map[] = {
     {STATUS_IS_NO_JOB_CTRL, L"is-no-job-control"},
     {STATUS_SET_JOB_CONTROL, L"job-control"},
     {STATUS_LINE_NUMBER, L"line-number"},
+    {STATUS_PERF, L"perf"},
     {STATUS_STACK_TRACE, L"print-stack-trace"},
     {STATUS_STACK_TRACE, L"stack-trace"},
     {STATUS_TEST_FEATURE, L"test-feature"},
@@ -459,6 +462,24 @@ maybe_t<int> builtin_status(parser_t &parser, io_streams_t &streams, wchar_t **a
             streams.out.push_back(L'\n');
             break;
         }
+        case STATUS_PERF: {
+            if (args.size() > 1) {
+                const wchar_t *subcmd_str = enum_to_str(opts.status_cmd, status_enum_map);
+                streams.err.append_format(BUILTIN_ERR_ARG_COUNT2, cmd, subcmd_str, 1, args.size());
+                return STATUS_INVALID_ARGS;
+            }
+            bool reset = false;
+            if (args.size() == 1) {
+                if (args.front() != L"reset") {
+                    streams.err.append_format(_(L"%ls: Invalid perf action '%ls'\n"), cmd,
+                                              args.front().c_str());
+                    return STATUS_INVALID_ARGS;
+                }
+                reset = true;
+            }
+            streams.out.append(perf_counters_report(reset));
+            break;
+        }
     }
 
     return retval;
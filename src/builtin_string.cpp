@@ -12,6 +12,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <cwchar>
 #include <cwctype>
 #include <iterator>
@@ -26,6 +27,7 @@
 #include "fallback.h"  // IWYU pragma: keep
 #include "future_feature_flags.h"
 #include "io.h"
+#include "lru.h"
 #include "parse_util.h"
 #include "pcre2.h"
 #include "wcstringutil.h"
@@ -35,11 +37,15 @@
 
 class parser_t;
 
-// How many bytes we read() at once.
+// How many bytes we read() at once, initially.
 // Bash uses 128 here, so we do too (see READ_CHUNK_SIZE).
 // This should be about the size of a line.
 #define STRING_CHUNK_SIZE 128
 
+// The largest read() we grow to when reads keep filling the chunk, i.e. when lots of input is
+// being piped into us.
+#define STRING_MAX_CHUNK_SIZE (256 * 1024)
+
 static void string_error(io_streams_t &streams, const wchar_t *fmt, ...) {
     streams.err.append(L"string ");
     va_list va;
@@ -70,45 +76,75 @@ class arg_iterator_t {
     const wchar_t *const *argv_;
     // If using argv, index of the next argument to return.
     int argidx_;
-    // If not using argv, a string to store bytes that have been read but not yet returned.
+    // If not using argv, a string to store bytes that have been read. Bytes before buffer_start_
+    // have already been returned.
     std::string buffer_;
+    size_t buffer_start_{0};
+    // How many bytes to read() next. This grows while reads fill it.
+    size_t chunk_size_{STRING_CHUNK_SIZE};
     // If set, when reading from a stream, split on newlines.
     const bool split_;
     // Backing storage for the next() string.
     wcstring storage_;
     const io_streams_t &streams_;
 
+    /// Set storage_ to the bytes in [buffer_start_, end) and advance buffer_start_ to \p next.
+    void take_buffer(size_t end, size_t next) {
+        str2wcstring(buffer_.data() + buffer_start_, end - buffer_start_, &storage_);
+        buffer_start_ = next;
+    }
+
     /// Reads the next argument from stdin, returning true if an argument was produced and false if
     /// not. On true, the string is stored in storage_.
     bool get_arg_stdin() {
         assert(string_args_from_stdin(streams_) && "should not be reading from stdin");
         // Read in chunks from fd until buffer has a line (or the end if split_ is unset).
-        size_t pos;
-        while (!split_ || (pos = buffer_.find('\n')) == std::string::npos) {
-            char buf[STRING_CHUNK_SIZE];
-            long n = read_blocked(streams_.stdin_fd, buf, STRING_CHUNK_SIZE);
+        // search_start is where to look for the next newline, so that we don't rescan bytes we
+        // already know are not newlines.
+        size_t search_start = buffer_start_;
+        const char *newline = nullptr;
+        while (!split_ || !(newline = static_cast<const char *>(
+                                std::memchr(buffer_.data() + search_start, '\n',
+                                            buffer_.size() - search_start)))) {
+            search_start = buffer_.size();
+
+            // Drop what has been returned already before reading more. What remains is (at most)
+            // one partial line, so this keeps the whole thing linear.
+            if (buffer_start_ > 0) {
+                buffer_.erase(0, buffer_start_);
+                search_start -= buffer_start_;
+                buffer_start_ = 0;
+            }
+
+            // Don't hold back output while we wait for input; it might be a while.
+            streams_.out.flush();
+
+            size_t old_size = buffer_.size();
+            buffer_.resize(old_size + chunk_size_);
+            long n = read_blocked(streams_.stdin_fd, &buffer_[old_size], chunk_size_);
+            buffer_.resize(old_size + (n > 0 ? n : 0));
             if (n == 0) {
                 // If we still have buffer contents, flush them,
                 // in case there was no trailing sep.
                 if (buffer_.empty()) return false;
-                storage_ = str2wcstring(buffer_);
-                buffer_.clear();
+                take_buffer(buffer_.size(), buffer_.size());
                 return true;
             }
             if (n == -1) {
                 // Some error happened. We can't do anything about it,
                 // so ignore it.
                 // (read_blocked already retries for EAGAIN and EINTR)
-                storage_ = str2wcstring(buffer_);
-                buffer_.clear();
+                take_buffer(buffer_.size(), buffer_.size());
                 return false;
             }
-            buffer_.append(buf, n);
+            if (static_cast<size_t>(n) == chunk_size_ && chunk_size_ < STRING_MAX_CHUNK_SIZE) {
+                chunk_size_ *= 2;
+            }
         }
 
         // Split the buffer on the sep and return the first part.
-        storage_ = str2wcstring(buffer_, pos);
-        buffer_.erase(0, pos + 1);
+        size_t pos = newline - buffer_.data();
+        take_buffer(pos, pos + 1);
         return true;
     }
 
@@ -719,6 +755,26 @@ class wildcard_matcher_t : public string_matcher_t {
 
     ~wildcard_matcher_t() override = default;
 
+    /// \return the text matched if the pattern only matches one exact string, or null if not.
+    const wcstring *literal_pattern() const {
+        if (opts.ignore_case || opts.invert_match || opts.entire) return nullptr;
+        return wildcard_has(wcpattern, true) ? nullptr : &wcpattern;
+    }
+
+    /// Report \p count arguments equal to the literal pattern.
+    void report_literal_matches(size_t count) {
+        total_matched += static_cast<int>(count);
+        if (opts.quiet) return;
+        for (size_t i = 0; i < count; i++) {
+            if (opts.index) {
+                streams.out.append_format(L"1 %lu\n", wcpattern.length());
+            } else {
+                streams.out.append(wcpattern);
+                streams.out.append(L'\n');
+            }
+        }
+    }
+
     bool report_matches(const wcstring &arg) override {
         // Note: --all is a no-op for glob matching since the pattern is always matched
         // against the entire argument.
@@ -752,13 +808,60 @@ static wcstring pcre2_strerror(int err_code) {
     return buf;
 }
 
+/// A compiled pcre2 pattern. This is immutable once compiled and may be shared between threads;
+/// each user must create its own match data.
+using shared_pcre2_code_t = std::shared_ptr<pcre2_code>;
+
+/// How many compiled patterns we keep around.
+static constexpr size_t kRegexCacheSize = 64;
+
+/// A cache of compiled patterns, so that `string match -r` and `string replace -r` in a loop do not
+/// recompile (and re-JIT) the same pattern on every invocation. The key is the pattern prefixed by
+/// a character encoding the compile flags.
+class regex_cache_t : public lru_cache_t<regex_cache_t, shared_pcre2_code_t> {
+   public:
+    regex_cache_t() : lru_cache_t<regex_cache_t, shared_pcre2_code_t>(kRegexCacheSize) {}
+
+    static wcstring make_key(const wcstring &pattern, bool ignore_case) {
+        wcstring key;
+        key.reserve(pattern.size() + 1);
+        key.push_back(ignore_case ? L'i' : L'-');
+        key.append(pattern);
+        return key;
+    }
+};
+static owning_lock<regex_cache_t> s_regex_cache;
+
 struct compiled_regex_t {
+    shared_pcre2_code_t code_ref;
     pcre2_code *code;
     pcre2_match_data *match;
 
     compiled_regex_t(const wchar_t *argv0, const wcstring &pattern, bool ignore_case,
                      io_streams_t &streams)
         : code(nullptr), match(nullptr) {
+        wcstring key = regex_cache_t::make_key(pattern, ignore_case);
+        {
+            auto cache = s_regex_cache.acquire();
+            if (shared_pcre2_code_t *cached = cache->get(key)) code_ref = *cached;
+        }
+
+        if (!code_ref) {
+            code_ref = compile(argv0, pattern, ignore_case, streams);
+            if (!code_ref) return;
+            s_regex_cache.acquire()->insert(std::move(key), code_ref);
+        }
+
+        code = code_ref.get();
+        match = pcre2_match_data_create_from_pattern(code, nullptr);
+        assert(match);
+    }
+
+    ~compiled_regex_t() { pcre2_match_data_free(match); }
+
+   private:
+    static shared_pcre2_code_t compile(const wchar_t *argv0, const wcstring &pattern,
+                                       bool ignore_case, io_streams_t &streams) {
         // Disable some sequences that can lead to security problems.
         uint32_t options = PCRE2_NEVER_UTF;
 #if PCRE2_CODE_UNIT_WIDTH < 32
@@ -768,24 +871,23 @@ struct compiled_regex_t {
         int err_code = 0;
         PCRE2_SIZE err_offset = 0;
 
-        code = pcre2_compile(PCRE2_SPTR(pattern.c_str()), pattern.length(),
-                             options | (ignore_case ? PCRE2_CASELESS : 0), &err_code, &err_offset,
-                             nullptr);
+        pcre2_code *code =
+            pcre2_compile(PCRE2_SPTR(pattern.c_str()), pattern.length(),
+                          options | (ignore_case ? PCRE2_CASELESS : 0), &err_code, &err_offset,
+                          nullptr);
         if (code == nullptr) {
             string_error(streams, _(L"%ls: Regular expression compile error: %ls\n"), argv0,
                          pcre2_strerror(err_code).c_str());
             string_error(streams, L"%ls: %ls\n", argv0, pattern.c_str());
             string_error(streams, L"%ls: %*ls\n", argv0, err_offset, L"^");
-            return;
+            return nullptr;
         }
 
-        match = pcre2_match_data_create_from_pattern(code, nullptr);
-        assert(match);
-    }
-
-    ~compiled_regex_t() {
-        pcre2_match_data_free(match);
-        pcre2_code_free(code);
+        // Try to JIT-compile the pattern. This fails if pcre2 was built without JIT support or the
+        // platform does not allow executable memory; pcre2_match() then falls back to the
+        // interpreter, so the error is ignored.
+        (void)pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+        return shared_pcre2_code_t(code, pcre2_code_free);
     }
 };
 
@@ -924,7 +1026,16 @@ static int string_match(parser_t &parser, io_streams_t &streams, int argc, wchar
     if (opts.regex) {
         matcher = make_unique<pcre2_matcher_t>(cmd, pattern, opts, streams);
     } else {
-        matcher = make_unique<wildcard_matcher_t>(cmd, pattern, opts, streams);
+        auto wildcard_matcher = make_unique<wildcard_matcher_t>(cmd, pattern, opts, streams);
+        // Every match of a pattern without wildcards prints the same thing, so all we need is the
+        // number of matches, which may be found through a variable's index.
+        const wcstring *literal = wildcard_matcher->literal_pattern();
+        if (literal && !string_args_from_stdin(streams)) {
+            wildcard_matcher->report_literal_matches(
+                builtin_find_args(streams, argv, optind, argc, *literal, nullptr, opts.quiet));
+            return wildcard_matcher->match_count() > 0 ? STATUS_CMD_OK : STATUS_CMD_ERROR;
+        }
+        matcher = std::move(wildcard_matcher);
     }
 
     arg_iterator_t aiter(argv, optind, streams);
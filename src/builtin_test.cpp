@@ -22,6 +22,7 @@
 
 #include "common.h"
 #include "io.h"
+#include "lru.h"
 #include "parser.h"
 #include "wutil.h"  // IWYU pragma: keep
 
@@ -157,10 +158,13 @@ const token_info_t *token_for_string(const wcstring &str) {
         {L"-o", {test_combine_or, 0}},
         {L"(", {test_paren_open, 0}},
         {L")", {test_paren_close, 0}}};
+    static const token_info_t *const unknown_info = &token_infos.find(L"")->second;
 
+    // Every token starts with one of these characters, and most arguments are plain strings.
+    if (str.empty() || !std::wcschr(L"-!=()", str.front())) return unknown_info;
     auto t = token_infos.find(str);
     if (t != token_infos.end()) return &t->second;
-    return &token_infos.find(L"")->second;
+    return unknown_info;
 }
 
 // Grammar.
@@ -215,7 +219,8 @@ struct range_t {
     range_t(unsigned s, unsigned e) : start(s), end(e) {}
 };
 
-/// Base class for expressions.
+/// Base class for expressions. Expressions refer to their arguments by index, so one expression
+/// can be evaluated against any arguments that parse the same way.
 class expression {
    protected:
     expression(token_t what, range_t where) : token(what), range(where) {}
@@ -227,27 +232,21 @@ class expression {
     virtual ~expression() = default;
 
     /// Evaluate returns true if the expression is true (i.e. STATUS_CMD_OK).
-    virtual bool evaluate(wcstring_list_t &errors) = 0;
+    virtual bool evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const = 0;
 };
 
-/// Single argument like -n foo or "just a string".
+/// Single argument like -n foo or "just a string". The argument is the last in the range.
 class unary_primary : public expression {
    public:
-    wcstring arg;
-    unary_primary(token_t tok, range_t where, wcstring what)
-        : expression(tok, where), arg(std::move(what)) {}
-    bool evaluate(wcstring_list_t &errors) override;
+    unary_primary(token_t tok, range_t where) : expression(tok, where) {}
+    bool evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const override;
 };
 
-/// Two argument primary like foo != bar.
+/// Two argument primary like foo != bar. The arguments are the first and last in the range.
 class binary_primary : public expression {
    public:
-    wcstring arg_left;
-    wcstring arg_right;
-
-    binary_primary(token_t tok, range_t where, wcstring left, wcstring right)
-        : expression(tok, where), arg_left(std::move(left)), arg_right(std::move(right)) {}
-    bool evaluate(wcstring_list_t &errors) override;
+    binary_primary(token_t tok, range_t where) : expression(tok, where) {}
+    bool evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const override;
 };
 
 /// Unary operator like bang.
@@ -256,7 +255,7 @@ class unary_operator : public expression {
     unique_ptr<expression> subject;
     unary_operator(token_t tok, range_t where, unique_ptr<expression> exp)
         : expression(tok, where), subject(move(exp)) {}
-    bool evaluate(wcstring_list_t &errors) override;
+    bool evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const override;
 };
 
 /// Combining expression. Contains a list of AND or OR expressions. It takes more than two so that
@@ -275,7 +274,7 @@ class combining_expression : public expression {
 
     ~combining_expression() override = default;
 
-    bool evaluate(wcstring_list_t &errors) override;
+    bool evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const override;
 };
 
 /// Parenthetical expression.
@@ -285,7 +284,7 @@ class parenthetical_expression : public expression {
     parenthetical_expression(token_t tok, range_t where, unique_ptr<expression> expr)
         : expression(tok, where), contents(move(expr)) {}
 
-    bool evaluate(wcstring_list_t &errors) override;
+    bool evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const override;
 };
 
 void test_parser::add_error(unsigned int idx, const wchar_t *fmt, ...) {
@@ -392,7 +391,7 @@ unique_ptr<expression> test_parser::parse_unary_primary(unsigned int start, unsi
     const token_info_t *info = token_for_string(arg(start));
     if (!(info->flags & UNARY_PRIMARY)) return nullptr;
 
-    return make_unique<unary_primary>(info->tok, range_t(start, start + 2), arg(start + 1));
+    return make_unique<unary_primary>(info->tok, range_t(start, start + 2));
 }
 
 unique_ptr<expression> test_parser::parse_just_a_string(unsigned int start, unsigned int end) {
@@ -411,7 +410,7 @@ unique_ptr<expression> test_parser::parse_just_a_string(unsigned int start, unsi
 
     // This is hackish; a nicer way to implement this would be with a "just a string" expression
     // type.
-    return make_unique<unary_primary>(test_string_n, range_t(start, start + 1), arg(start));
+    return make_unique<unary_primary>(test_string_n, range_t(start, start + 1));
 }
 
 unique_ptr<expression> test_parser::parse_binary_primary(unsigned int start, unsigned int end) {
@@ -426,8 +425,7 @@ unique_ptr<expression> test_parser::parse_binary_primary(unsigned int start, uns
     const token_info_t *info = token_for_string(arg(start + 1));
     if (!(info->flags & BINARY_PRIMARY)) return nullptr;
 
-    return make_unique<binary_primary>(info->tok, range_t(start, start + 3), arg(start),
-                                       arg(start + 2));
+    return make_unique<binary_primary>(info->tok, range_t(start, start + 3));
 }
 
 unique_ptr<expression> test_parser::parse_parenthentical(unsigned int start, unsigned int end) {
@@ -595,31 +593,31 @@ unique_ptr<expression> test_parser::parse_args(const wcstring_list_t &args, wcst
     return result;
 }
 
-bool unary_primary::evaluate(wcstring_list_t &errors) {
-    return unary_primary_evaluate(token, arg, errors);
+bool unary_primary::evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const {
+    return unary_primary_evaluate(token, args.at(range.end - 1), errors);
 }
 
-bool binary_primary::evaluate(wcstring_list_t &errors) {
-    return binary_primary_evaluate(token, arg_left, arg_right, errors);
+bool binary_primary::evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const {
+    return binary_primary_evaluate(token, args.at(range.start), args.at(range.start + 2), errors);
 }
 
-bool unary_operator::evaluate(wcstring_list_t &errors) {
+bool unary_operator::evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const {
     if (token == test_bang) {
         assert(subject.get());
-        return !subject->evaluate(errors);
+        return !subject->evaluate(args, errors);
     }
 
     errors.push_back(format_string(L"Unknown token type in %s", __func__));
     return false;
 }
 
-bool combining_expression::evaluate(wcstring_list_t &errors) {
+bool combining_expression::evaluate(const wcstring_list_t &args, wcstring_list_t &errors) const {
     if (token == test_combine_and || token == test_combine_or) {
         assert(!subjects.empty());  //!OCLINT(multiple unary operator)
         assert(combiners.size() + 1 == subjects.size());
 
         // One-element case.
-        if (subjects.size() == 1) return subjects.at(0)->evaluate(errors);
+        if (subjects.size() == 1) return subjects.at(0)->evaluate(args, errors);
 
         // Evaluate our lists, remembering that AND has higher precedence than OR. We can
         // visualize this as a sequence of OR expressions of AND expressions.
@@ -635,7 +633,7 @@ bool combining_expression::evaluate(wcstring_list_t &errors) {
             bool and_result = true;
             for (; idx < max; idx++) {
                 // Evaluate it, short-circuiting.
-                and_result = and_result && subjects.at(idx)->evaluate(errors);
+                and_result = and_result && subjects.at(idx)->evaluate(args, errors);
 
                 // If the combiner at this index (which corresponding to how we combine with the
                 // next subject) is not AND, then exit the loop.
@@ -655,8 +653,9 @@ bool combining_expression::evaluate(wcstring_list_t &errors) {
     return false;
 }
 
-bool parenthetical_expression::evaluate(wcstring_list_t &errors) {
-    return contents->evaluate(errors);
+bool parenthetical_expression::evaluate(const wcstring_list_t &args,
+                                        wcstring_list_t &errors) const {
+    return contents->evaluate(args, errors);
 }
 
 // Parse a double from arg. Return true on success, false on failure.
@@ -676,6 +675,22 @@ static bool parse_double(const wchar_t *arg, double *out_res) {
 // which allows for leading + and -, and whitespace. This is consistent, albeit a bit more lenient
 // since we allow trailing whitespace, with other implementations such as bash.
 static bool parse_number(const wcstring &arg, number_t *number, wcstring_list_t &errors) {
+    // Fast path for plain decimal integers, which are what scripts nearly always compare. 18 digits
+    // can't overflow a long long.
+    size_t digits_start = (!arg.empty() && (arg[0] == L'-' || arg[0] == L'+')) ? 1 : 0;
+    size_t digit_count = arg.size() - digits_start;
+    if (digit_count > 0 && digit_count <= 18) {
+        long long value = 0;
+        size_t idx = digits_start;
+        for (; idx < arg.size() && arg[idx] >= L'0' && arg[idx] <= L'9'; idx++) {
+            value = value * 10 + (arg[idx] - L'0');
+        }
+        if (idx == arg.size()) {
+            *number = number_t{arg[0] == L'-' ? -value : value, 0.0};
+            return true;
+        }
+    }
+
     const wchar_t *argcs = arg.c_str();
     double floating = 0;
     bool got_float = parse_double(argcs, &floating);
@@ -840,6 +855,19 @@ static bool unary_primary_evaluate(test_expressions::token_t token, const wcstri
 };  // namespace test_expressions
 };  // anonymous namespace
 
+/// Number of parsed expressions to keep around.
+static constexpr size_t kExpressionCacheSize = 64;
+
+using shared_expression_t = std::shared_ptr<const test_expressions::expression>;
+
+/// Parsed expressions, keyed by the token type of each argument.
+class expression_cache_t : public lru_cache_t<expression_cache_t, shared_expression_t> {
+   public:
+    expression_cache_t()
+        : lru_cache_t<expression_cache_t, shared_expression_t>(kExpressionCacheSize) {}
+};
+static owning_lock<expression_cache_t> s_expression_cache;
+
 /// Evaluate a conditional expression given the arguments. If fromtest is set, the caller is the
 /// test or [ builtin; with the pointer giving the name of the command. for POSIX conformance this
 /// supports a more limited range of functionality.
@@ -882,17 +910,32 @@ maybe_t<int> builtin_test(parser_t &parser, io_streams_t &streams, wchar_t **arg
         return args.at(0).empty() ? STATUS_CMD_ERROR : STATUS_CMD_OK;
     }
 
-    // Try parsing
-    wcstring err;
-    unique_ptr<expression> expr = test_parser::parse_args(args, err, program_name);
+    // How the arguments parse only depends on which of them are operators, so look for an
+    // expression parsed from arguments with the same operators, like `test $i -lt $n` in a loop.
+    wcstring skeleton;
+    skeleton.reserve(args.size());
+    for (const wcstring &arg : args) {
+        skeleton.push_back(L'A' + token_for_string(arg)->tok);
+    }
+    shared_expression_t expr;
+    {
+        auto cache = s_expression_cache.acquire();
+        if (shared_expression_t *cached = cache->get(skeleton)) expr = *cached;
+    }
+
     if (!expr) {
-        streams.err.append(err);
-        streams.err.append(parser.current_line());
-        return STATUS_CMD_ERROR;
+        wcstring err;
+        expr = test_parser::parse_args(args, err, program_name);
+        if (!expr) {
+            streams.err.append(err);
+            streams.err.append(parser.current_line());
+            return STATUS_CMD_ERROR;
+        }
+        s_expression_cache.acquire()->insert(std::move(skeleton), expr);
     }
 
     wcstring_list_t eval_errors;
-    bool result = expr->evaluate(eval_errors);
+    bool result = expr->evaluate(args, eval_errors);
     if (!eval_errors.empty()) {
         if (!should_suppress_stderr_for_tests()) {
             for (const auto &eval_error : eval_errors) {
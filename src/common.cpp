@@ -237,17 +237,18 @@ bool is_windows_subsystem_for_linux() {
 }
 #endif  // HAVE_BACKTRACE_SYMBOLS
 
-/// Converts the narrow character string \c in into its wide equivalent, and return it.
+/// Converts the narrow character string \c in into its wide equivalent, storing it in \p result
+/// (whose previous contents are discarded but whose storage is reused).
 ///
 /// The string may contain embedded nulls.
 ///
 /// This function encodes illegal character sequences in a reversible way using the private use
 /// area.
-static wcstring str2wcs_internal(const char *in, const size_t in_len) {
-    if (in_len == 0) return wcstring();
+static void str2wcs_internal(const char *in, const size_t in_len, wcstring &result) {
+    result.clear();
+    if (in_len == 0) return;
     assert(in != nullptr);
 
-    wcstring result;
     result.reserve(in_len);
     size_t in_pos = 0;
 
@@ -257,7 +258,7 @@ static wcstring str2wcs_internal(const char *in, const size_t in_len) {
             result.push_back(static_cast<unsigned char>(in[in_pos]));
             in_pos++;
         }
-        return result;
+        return;
     }
 
     mbstate_t state = {};
@@ -314,7 +315,11 @@ static wcstring str2wcs_internal(const char *in, const size_t in_len) {
             in_pos += ret;
         }
     }
+}
 
+static wcstring str2wcs_internal(const char *in, const size_t in_len) {
+    wcstring result;
+    str2wcs_internal(in, in_len, result);
     return result;
 }
 
@@ -332,6 +337,11 @@ wcstring str2wcstring(const std::string &in, size_t len) {
     return str2wcs_internal(in.data(), len);
 }
 
+void str2wcstring(const char *in, size_t len, wcstring *out) {
+    assert(out && "Null output string");
+    str2wcs_internal(in, len, *out);
+}
+
 std::string wcs2string(const wcstring &input) {
     std::string result;
     result.reserve(input.size());
@@ -844,6 +854,59 @@ static bool unescape_string_var(const wchar_t *in, wcstring *out) {
     return true;
 }
 
+/// Whether escaping and unescaping copy runs of ordinary characters in bulk. Only turned off to
+/// compare against the character-at-a-time paths in tests.
+static relaxed_atomic_bool_t escape_fast_paths{true};
+
+void set_escape_fast_paths_for_testing(bool enabled) { escape_fast_paths = enabled; }
+
+namespace {
+/// For each ASCII character, the contexts in which escaping or unescaping copies it unchanged.
+enum : uint8_t {
+    plain_when_escaping = 1 << 0,
+    plain_unquoted = 1 << 1,
+    plain_in_single_quotes = 1 << 2,
+    plain_in_double_quotes = 1 << 3,
+};
+
+struct plain_char_table_t {
+    uint8_t flags[128];
+
+    void clear(uint8_t context, const char *chars) {
+        for (; *chars; chars++) flags[static_cast<uint8_t>(*chars)] &= ~context;
+    }
+
+    plain_char_table_t() {
+        for (int c = 0; c < 128; c++) {
+            flags[c] = plain_unquoted | plain_in_single_quotes | plain_in_double_quotes;
+            // Control characters and space get escaped, but DEL does not.
+            if (c > 32) flags[c] |= plain_when_escaping;
+        }
+        clear(plain_when_escaping, "\\'&$#^<>()[]{}?*|;\"%~");
+        clear(plain_unquoted, "\\~%*?${}, '\"");
+        clear(plain_in_single_quotes, "\\'");
+        clear(plain_in_double_quotes, "\\\"$");
+    }
+};
+const plain_char_table_t s_plain_chars;
+}  // namespace
+
+/// \return how many characters at the start of \p in, up to \p len, are plain in \p context.
+/// Non-ASCII characters are plain everywhere, except for the ones escaping has to encode.
+static inline size_t plain_run_length(const wchar_t *in, size_t len, uint8_t context) {
+    const bool escaping = context == plain_when_escaping;
+    size_t i = 0;
+    for (; i < len; i++) {
+        wchar_t c = in[i];
+        if (c >= 0 && c < 128) {
+            if (!(s_plain_chars.flags[c] & context)) break;
+        } else if (escaping && (c < 0 || c >= ENCODE_DIRECT_BASE)) {
+            break;
+        }
+    }
+    return i;
+}
+
 /// Escape a string in a fashion suitable for using in fish script. Store the result in out_str.
 static void escape_string_script(const wchar_t *orig_in, size_t in_len, wcstring &out,
                                  escape_flags_t flags) {
@@ -862,7 +925,16 @@ static void escape_string_script(const wchar_t *orig_in, size_t in_len, wcstring
         return;
     }
 
+    out.reserve(out.size() + in_len);
     for (size_t i = 0; i < in_len; i++) {
+        if (escape_fast_paths) {
+            size_t run = plain_run_length(in, in_len - i, plain_when_escaping);
+            out.append(in, run);
+            in += run;
+            i += run;
+            if (i == in_len) break;
+        }
+
         if ((*in >= ENCODE_DIRECT_BASE) && (*in < ENCODE_DIRECT_BASE + 256)) {
             int val = *in - ENCODE_DIRECT_BASE;
             int tmp;
@@ -1328,6 +1400,17 @@ static bool unescape_string_internal(const wchar_t *const input, const size_t in
     } mode = mode_unquoted;
 
     for (size_t input_position = 0; input_position < input_len && !errored; input_position++) {
+        if (escape_fast_paths) {
+            uint8_t context = mode == mode_unquoted        ? plain_unquoted
+                              : mode == mode_single_quotes ? plain_in_single_quotes
+                                                           : plain_in_double_quotes;
+            size_t run =
+                plain_run_length(input + input_position, input_len - input_position, context);
+            result.append(input + input_position, run);
+            input_position += run;
+            if (input_position == input_len) break;
+        }
+
         const wchar_t c = input[input_position];
         // Here's the character we'll append to result, or none() to suppress it.
         maybe_t<wchar_t> to_append_or_none = c;
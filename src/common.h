@@ -7,6 +7,7 @@
 #include <limits.h>
 // Needed for va_list et al.
 #include <stdarg.h>  // IWYU pragma: keep
+#include <stdint.h>
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>  // IWYU pragma: keep
 #endif
@@ -285,6 +286,10 @@ wcstring str2wcstring(const char *in, size_t len);
 wcstring str2wcstring(const std::string &in);
 wcstring str2wcstring(const std::string &in, size_t len);
 
+/// Like str2wcstring, but stores the result in \p out, reusing its storage. This is useful when
+/// converting many strings in a loop.
+void str2wcstring(const char *in, size_t len, wcstring *out);
+
 /// Returns a newly allocated multibyte character string equivalent of the specified wide character
 /// string.
 ///
@@ -664,6 +669,9 @@ bool is_main_thread();
 /// Configures thread assertions for testing.
 void configure_thread_assertions_for_testing();
 
+/// Enable or disable bulk copying in escaping and unescaping, to compare against the slow paths.
+void set_escape_fast_paths_for_testing(bool enabled);
+
 /// Set up a guard to complain if we try to do certain things (like take a lock) after calling fork.
 void setup_fork_guards(void);
 
@@ -754,6 +762,35 @@ static const wchar_t *enum_to_str(T enum_val, const enum_map<T> map[]) {
     return nullptr;
 };
 
+/// A seeded FNV-1a hash of \p name, usable at compile time. This is for perfect hash tables over
+/// fixed sets of names, like the builtins: the seed is picked so that no two names land in the same
+/// slot, which names_hash_perfectly() can check in a static_assert.
+constexpr uint32_t name_hash(const wchar_t *name, uint32_t seed) {
+    return *name ? name_hash(name + 1, (seed ^ static_cast<uint32_t>(*name)) * 16777619u) : seed;
+}
+
+/// Return the slot of \p name in a perfect hash table with 2^bits slots.
+constexpr uint32_t name_hash_slot(const wchar_t *name, uint32_t seed, unsigned bits) {
+    return name_hash(name, seed) >> (32 - bits);
+}
+
+/// Return whether the name of items[i] doesn't share its slot with any of items[j..count).
+template <typename T, typename Name>
+constexpr bool name_slot_is_unique(const T *items, size_t count, Name T::*name, uint32_t seed,
+                                   unsigned bits, size_t i, size_t j) {
+    return j >= count || (name_hash_slot(items[i].*name, seed, bits) !=
+                              name_hash_slot(items[j].*name, seed, bits) &&
+                          name_slot_is_unique(items, count, name, seed, bits, i, j + 1));
+}
+
+/// Return whether the names of the first \p count \p items all hash to different slots.
+template <typename T, typename Name>
+constexpr bool names_hash_perfectly(const T *items, size_t count, Name T::*name, uint32_t seed,
+                                    unsigned bits, size_t i = 0) {
+    return i >= count || (name_slot_is_unique(items, count, name, seed, bits, i, i + 1) &&
+                          names_hash_perfectly(items, count, name, seed, bits, i + 1));
+}
+
 void redirect_tty_output();
 
 std::string get_path_to_tmp_dir();
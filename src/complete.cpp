@@ -43,6 +43,7 @@
 #include "parser.h"
 #include "parser_keywords.h"
 #include "path.h"
+#include "perf_counters.h"
 #include "proc.h"
 #include "reader.h"
 #include "util.h"
@@ -1655,6 +1656,7 @@ void completer_t::perform() {
 
 completion_list_t complete(const wcstring &cmd_with_subcmds, completion_request_flags_t flags,
                            const operation_context_t &ctx) {
+    perf_timer_t timer(perf_counter_t::complete);
     // Determine the innermost subcommand.
     const wchar_t *cmdsubst_begin, *cmdsubst_end;
     parse_util_cmdsubst_extent(cmd_with_subcmds.c_str(), cmd_with_subcmds.size(), &cmdsubst_begin,
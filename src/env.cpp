@@ -143,16 +143,66 @@ static export_generation_t next_export_generation() {
     return ++*val;
 }
 
-const wcstring_list_t &env_var_t::as_list() const { return *vals_; }
+const wcstring_list_t &env_var_t::as_list() const { return vals_->list; }
+
+/// Lists shorter than this are searched linearly; it's not worth hashing them.
+static constexpr size_t kMinIndexedValues = 16;
+
+/// The index of a list of values: the hash of each value paired with its index, sorted. Values
+/// which hash equally thus end up next to each other, in order.
+struct env_var_t::values_index_t {
+    std::vector<std::pair<size_t, size_t>> entries;
+};
+
+env_var_t::values_t::~values_t() { delete index.load(std::memory_order_relaxed); }
+
+size_t env_var_t::count_values(const wcstring &val, size_t *first) const {
+    const wcstring_list_t &list = vals_->list;
+    size_t count = 0;
+    if (list.size() < kMinIndexedValues) {
+        for (size_t i = 0; i < list.size(); i++) {
+            if (list[i] != val) continue;
+            if (count++ == 0 && first) *first = i;
+        }
+        return count;
+    }
+
+    // Get the index, building it if this is the first search. Another thread may race us to it;
+    // the loser throws its index away.
+    std::hash<wcstring> hasher;
+    const values_index_t *index = vals_->index.load(std::memory_order_acquire);
+    if (!index) {
+        auto built = new values_index_t();
+        built->entries.reserve(list.size());
+        for (size_t i = 0; i < list.size(); i++) {
+            built->entries.emplace_back(hasher(list[i]), i);
+        }
+        std::sort(built->entries.begin(), built->entries.end());
+        if (vals_->index.compare_exchange_strong(index, built, std::memory_order_acq_rel)) {
+            index = built;
+        } else {
+            delete built;
+        }
+    }
+
+    size_t hash = hasher(val);
+    auto iter = std::lower_bound(index->entries.begin(), index->entries.end(),
+                                 std::make_pair(hash, size_t(0)));
+    for (; iter != index->entries.end() && iter->first == hash; ++iter) {
+        if (list[iter->second] != val) continue;
+        if (count++ == 0 && first) *first = iter->second;
+    }
+    return count;
+}
 
 wchar_t env_var_t::get_delimiter() const {
     return is_pathvar() ? PATH_ARRAY_SEP : NONPATH_ARRAY_SEP;
 }
 
 /// Return a string representation of the var.
-wcstring env_var_t::as_string() const { return join_strings(*vals_, get_delimiter()); }
+wcstring env_var_t::as_string() const { return join_strings(vals_->list, get_delimiter()); }
 
-void env_var_t::to_list(wcstring_list_t &out) const { out = *vals_; }
+void env_var_t::to_list(wcstring_list_t &out) const { out = vals_->list; }
 
 env_var_t::env_var_flags_t env_var_t::flags_for(const wchar_t *name) {
     env_var_flags_t result = 0;
@@ -161,8 +211,8 @@ env_var_t::env_var_flags_t env_var_t::flags_for(const wchar_t *name) {
 }
 
 /// \return a singleton empty list, to avoid unnecessary allocations in env_var_t.
-std::shared_ptr<const wcstring_list_t> env_var_t::empty_list() {
-    static const auto s_empty_result = std::make_shared<const wcstring_list_t>();
+std::shared_ptr<const env_var_t::values_t> env_var_t::empty_list() {
+    static const auto s_empty_result = std::make_shared<const values_t>(wcstring_list_t{});
     return s_empty_result;
 }
 
@@ -1290,7 +1340,7 @@ int env_stack_t::set(const wcstring &key, env_mode_flags_t mode, wcstring_list_t
         if (ret.global_modified || is_principal()) {
             env_dispatch_var_change(key, *this);
         }
-        if (out_events) {
+        if (out_events && event_is_variable_watched(key)) {
             out_events->push_back(event_t::variable(key, {L"VARIABLE", L"SET", key}));
         }
     }
@@ -1320,7 +1370,7 @@ int env_stack_t::remove(const wcstring &key, int mode, std::vector<event_t> *out
             // Important to not hold the lock here.
             env_dispatch_var_change(key, *this);
         }
-        if (out_events) {
+        if (out_events && event_is_variable_watched(key)) {
             out_events->push_back(event_t::variable(key, {L"VARIABLE", L"ERASE", key}));
         }
     }
@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -93,12 +94,24 @@ class env_var_t {
     using env_var_flags_t = uint8_t;
 
    private:
-    env_var_t(std::shared_ptr<const wcstring_list_t> vals, env_var_flags_t flags)
+    struct values_index_t;
+
+    /// The values of a variable, along with an index for finding a value, which is built the first
+    /// time a long list is searched. Values are never modified, so the index never goes stale.
+    struct values_t {
+        wcstring_list_t list;
+        mutable std::atomic<const values_index_t *> index{nullptr};
+
+        explicit values_t(wcstring_list_t list) : list(std::move(list)) {}
+        ~values_t();
+    };
+
+    env_var_t(std::shared_ptr<const values_t> vals, env_var_flags_t flags)
         : vals_(std::move(vals)), flags_(flags) {}
 
     /// The list of values in this variable.
     /// shared_ptr allows for cheap copying.
-    std::shared_ptr<const wcstring_list_t> vals_{empty_list()};
+    std::shared_ptr<const values_t> vals_{empty_list()};
 
     /// Flag in this variable.
     env_var_flags_t flags_{};
@@ -116,7 +129,7 @@ class env_var_t {
     env_var_t(env_var_t &&) = default;
 
     env_var_t(wcstring_list_t vals, env_var_flags_t flags)
-        : env_var_t(std::make_shared<wcstring_list_t>(std::move(vals)), flags) {}
+        : env_var_t(std::make_shared<const values_t>(std::move(vals)), flags) {}
 
     env_var_t(wcstring val, env_var_flags_t flags)
         : env_var_t(wcstring_list_t{std::move(val)}, flags) {}
@@ -127,7 +140,10 @@ class env_var_t {
 
     env_var_t(const wchar_t *name, wcstring val) : env_var_t(std::move(val), flags_for(name)) {}
 
-    bool empty() const { return vals_->empty() || (vals_->size() == 1 && vals_->front().empty()); }
+    bool empty() const {
+        const wcstring_list_t &list = vals_->list;
+        return list.empty() || (list.size() == 1 && list.front().empty());
+    }
     bool read_only() const { return flags_ & flag_read_only; }
     bool exports() const { return flags_ & flag_export; }
     bool is_pathvar() const { return flags_ & flag_pathvar; }
@@ -137,6 +153,10 @@ class env_var_t {
     void to_list(wcstring_list_t &out) const;
     const wcstring_list_t &as_list() const;
 
+    /// \return the number of values equal to \p val. If there are any and \p first is not null,
+    /// set it to the index of the first of them.
+    size_t count_values(const wcstring &val, size_t *first = nullptr) const;
+
     /// \return the character used when delimiting quoted expansion.
     wchar_t get_delimiter() const;
 
@@ -176,13 +196,13 @@ class env_var_t {
     }
 
     static env_var_flags_t flags_for(const wchar_t *name);
-    static std::shared_ptr<const wcstring_list_t> empty_list();
+    static std::shared_ptr<const values_t> empty_list();
 
     env_var_t &operator=(const env_var_t &var) = default;
     env_var_t &operator=(env_var_t &&) = default;
 
     bool operator==(const env_var_t &rhs) const {
-        return *vals_ == *rhs.vals_ && flags_ == rhs.flags_;
+        return vals_->list == rhs.vals_->list && flags_ == rhs.flags_;
     }
     bool operator!=(const env_var_t &rhs) const { return !(*this == rhs); }
 };
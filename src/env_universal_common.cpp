@@ -43,6 +43,7 @@
 #include "fallback.h"  // IWYU pragma: keep
 #include "flog.h"
 #include "path.h"
+#include "perf_counters.h"
 #include "utf8.h"
 #include "util.h"  // IWYU pragma: keep
 #include "wcstringutil.h"
@@ -642,6 +643,7 @@ bool env_universal_t::open_and_acquire_lock(const std::string &path, autoclose_f
 // changes due to other processes on a false return).
 bool env_universal_t::sync(callback_data_list_t &callbacks) {
     FLOGF(uvar_file, L"universal log sync");
+    perf_timer_t timer(perf_counter_t::uvar_sync);
     scoped_lock locker(lock);
     // Our saving strategy:
     //
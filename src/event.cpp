@@ -10,11 +10,15 @@
 #include <algorithm>
 #include <atomic>
 #include <functional>
+#include <map>
 #include <memory>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
 
 #include "common.h"
+#include "exec.h"
 #include "fallback.h"  // IWYU pragma: keep
 #include "input_common.h"
 #include "io.h"
@@ -84,8 +88,131 @@ class pending_signals_t {
 
 static pending_signals_t s_pending_signals;
 
+namespace {
+/// The event handlers, in the order they were added, and indexed by the events they match so that
+/// firing an event does not have to look at every handler.
+class event_handlers_t {
+    /// A handler and when it was added relative to the others.
+    struct entry_t {
+        uint64_t order;
+        shared_ptr<event_handler_t> handler;
+    };
+    using entry_list_t = std::vector<entry_t>;
+
+    /// All handlers, in the order they were added.
+    event_handler_list_t all_;
+
+    /// Variable and generic handlers by name.
+    std::unordered_map<wcstring, entry_list_t> variable_;
+    std::unordered_map<wcstring, entry_list_t> generic_;
+
+    /// Signal, exit and caller-exit handlers by their numeric parameter.
+    std::map<std::pair<event_type_t, uint64_t>, entry_list_t> numbered_;
+
+    /// Handlers which may match more than one parameter, which are checked against every event.
+    entry_list_t wildcard_;
+
+    uint64_t next_order_{0};
+
+    static bool is_wildcard(const event_description_t &desc) {
+        return desc.type == event_type_t::any ||
+               (desc.type == event_type_t::exit && desc.param1.pid == EVENT_ANY_PID);
+    }
+
+    static uint64_t numeric_param(const event_description_t &desc) {
+        switch (desc.type) {
+            case event_type_t::signal:
+                return static_cast<uint64_t>(desc.param1.signal);
+            case event_type_t::exit:
+                // Negative pids are process groups.
+                return static_cast<uint64_t>(static_cast<int64_t>(desc.param1.pid));
+            case event_type_t::caller_exit:
+                return desc.param1.caller_id;
+            default:
+                DIE("event type has no numeric parameter");
+        }
+    }
+
+    /// \return the list that handlers for \p desc go in, creating it if \p create is set, or
+    /// nullptr if there is none.
+    entry_list_t *bucket(const event_description_t &desc, bool create) {
+        if (is_wildcard(desc)) return &wildcard_;
+        switch (desc.type) {
+            case event_type_t::variable:
+            case event_type_t::generic: {
+                auto &map = desc.type == event_type_t::variable ? variable_ : generic_;
+                if (create) return &map[desc.str_param1];
+                auto where = map.find(desc.str_param1);
+                return where == map.end() ? nullptr : &where->second;
+            }
+            default: {
+                auto key = std::make_pair(desc.type, numeric_param(desc));
+                if (create) return &numbered_[key];
+                auto where = numbered_.find(key);
+                return where == numbered_.end() ? nullptr : &where->second;
+            }
+        }
+    }
+
+    /// Drop the list for \p desc if it has become empty.
+    void prune(const event_description_t &desc) {
+        if (is_wildcard(desc)) return;
+        switch (desc.type) {
+            case event_type_t::variable:
+            case event_type_t::generic: {
+                auto &map = desc.type == event_type_t::variable ? variable_ : generic_;
+                auto where = map.find(desc.str_param1);
+                if (where != map.end() && where->second.empty()) map.erase(where);
+                break;
+            }
+            default: {
+                auto where = numbered_.find(std::make_pair(desc.type, numeric_param(desc)));
+                if (where != numbered_.end() && where->second.empty()) numbered_.erase(where);
+                break;
+            }
+        }
+    }
+
+   public:
+    const event_handler_list_t &all() const { return all_; }
+
+    void add(shared_ptr<event_handler_t> eh) {
+        bucket(eh->desc, true)->push_back(entry_t{next_order_++, eh});
+        all_.push_back(std::move(eh));
+    }
+
+    void remove_function(const wcstring &name) {
+        auto is_named = [&](const shared_ptr<event_handler_t> &eh) {
+            return eh->function_name == name;
+        };
+        for (const shared_ptr<event_handler_t> &eh : all_) {
+            if (!is_named(eh)) continue;
+            eh->removed = true;
+            entry_list_t *list = bucket(eh->desc, false);
+            if (!list) continue;
+            list->erase(std::remove_if(list->begin(), list->end(),
+                                       [&](const entry_t &entry) { return entry.handler == eh; }),
+                        list->end());
+            prune(eh->desc);
+        }
+        all_.erase(std::remove_if(all_.begin(), all_.end(), is_named), all_.end());
+    }
+
+    /// \return whether any handler may match an event for the variable \p name.
+    bool watches_variable(const wcstring &name) const {
+        if (variable_.count(name)) return true;
+        return std::any_of(wildcard_.begin(), wildcard_.end(), [](const entry_t &entry) {
+            return entry.handler->desc.type == event_type_t::any;
+        });
+    }
+
+    /// \return the handlers matching \p event, in the order they were added.
+    event_handler_list_t matching(const event_t &event);
+};
+}  // namespace
+
 /// List of event handlers.
-static owning_lock<event_handler_list_t> s_event_handlers;
+static owning_lock<event_handlers_t> s_event_handlers;
 
 /// Variables (one per signal) set when a signal is observed. This is inspected by a signal handler.
 static volatile sig_atomic_t s_observed_signals[NSIG] = {};
@@ -127,6 +254,29 @@ static bool handler_matches(const event_handler_t &classv, const event_t &instan
     }
 }
 
+event_handler_list_t event_handlers_t::matching(const event_t &event) {
+    event_handler_list_t result;
+    const entry_list_t *exact = nullptr;
+    if (!is_wildcard(event.desc)) exact = bucket(event.desc, false);
+    if (!exact && wildcard_.empty()) return result;
+
+    // Interleave the exact matches with the wildcard handlers that match, keeping the order in
+    // which they were added. There are rarely any wildcard handlers.
+    static const entry_list_t no_entries;
+    if (!exact) exact = &no_entries;
+    auto wildcard = wildcard_.begin();
+    for (const entry_t &entry : *exact) {
+        for (; wildcard != wildcard_.end() && wildcard->order < entry.order; ++wildcard) {
+            if (handler_matches(*wildcard->handler, event)) result.push_back(wildcard->handler);
+        }
+        result.push_back(entry.handler);
+    }
+    for (; wildcard != wildcard_.end(); ++wildcard) {
+        if (handler_matches(*wildcard->handler, event)) result.push_back(wildcard->handler);
+    }
+    return result;
+}
+
 /// Test if specified event is blocked.
 static int event_is_blocked(parser_t &parser, const event_t &e) {
     (void)e;
@@ -188,23 +338,17 @@ void event_add_handler(std::shared_ptr<event_handler_t> eh) {
         set_signal_observed(eh->desc.param1.signal, true);
     }
 
-    s_event_handlers.acquire()->push_back(std::move(eh));
+    s_event_handlers.acquire()->add(std::move(eh));
 }
 
 void event_remove_function_handlers(const wcstring &name) {
-    auto handlers = s_event_handlers.acquire();
-    auto begin = handlers->begin(), end = handlers->end();
-    handlers->erase(std::remove_if(begin, end,
-                                   [&](const shared_ptr<event_handler_t> &eh) {
-                                       return eh->function_name == name;
-                                   }),
-                    end);
+    s_event_handlers.acquire()->remove_function(name);
 }
 
 event_handler_list_t event_get_function_handlers(const wcstring &name) {
     auto handlers = s_event_handlers.acquire();
     event_handler_list_t result;
-    for (const shared_ptr<event_handler_t> &eh : *handlers) {
+    for (const shared_ptr<event_handler_t> &eh : handlers->all()) {
         if (eh->function_name == name) {
             result.push_back(eh);
         }
@@ -212,6 +356,10 @@ event_handler_list_t event_get_function_handlers(const wcstring &name) {
     return result;
 }
 
+bool event_is_variable_watched(const wcstring &name) {
+    return s_event_handlers.acquire()->watches_variable(name);
+}
+
 bool event_is_signal_observed(int sig) {
     // We are in a signal handler! Don't allocate memory, etc.
     bool result = false;
@@ -234,31 +382,17 @@ static void event_fire_internal(parser_t &parser, const event_t &event) {
     scoped_push<bool> suppress_trace{&ld.suppress_fish_trace, true};
 
     // Capture the event handlers that match this event.
-    event_handler_list_t fire;
-    for (const auto &handler : *s_event_handlers.acquire()) {
-        // Check if this event is a match.
-        if (handler_matches(*handler, event)) {
-            fire.push_back(handler);
-        }
-    }
+    event_handler_list_t fire = s_event_handlers.acquire()->matching(event);
 
-    // Iterate over our list of matching events. Fire the ones that are still present.
+    // Iterate over our list of matching events. Fire the ones that are still present; a handler
+    // may remove (and thereby suppress) another.
     for (const shared_ptr<event_handler_t> &handler : fire) {
-        // Only fire if this event is still present.
-        // TODO: this is kind of crazy. We want to support removing (and thereby suppressing) an
-        // event handler from another, but we also don't want to hold the lock across callouts. How
-        // can we make this less silly?
-        if (!contains(*s_event_handlers.acquire(), handler)) {
-            continue;
-        }
+        if (handler->removed) continue;
 
-        // Construct a buffer to evaluate, starting with the function name and then all the
-        // arguments.
-        wcstring buffer = handler->function_name;
-        for (const wcstring &arg : event.arguments) {
-            buffer.push_back(L' ');
-            buffer.append(escape_string(arg, ESCAPE_ALL));
-        }
+        wcstring_list_t argv;
+        argv.reserve(1 + event.arguments.size());
+        argv.push_back(handler->function_name);
+        argv.insert(argv.end(), event.arguments.begin(), event.arguments.end());
 
         // Event handlers are not part of the main flow of code, so they are marked as
         // non-interactive.
@@ -266,7 +400,16 @@ static void event_fire_internal(parser_t &parser, const event_t &event) {
         auto prev_statuses = parser.get_last_statuses();
 
         block_t *b = parser.push_block(block_t::event_block(event));
-        parser.eval(buffer, io_chain_t());
+        if (!exec_function(parser, argv)) {
+            // The function is gone or not loaded. Run it as a command so that it is autoloaded or
+            // reported the way any other call would be.
+            wcstring buffer = handler->function_name;
+            for (const wcstring &arg : event.arguments) {
+                buffer.push_back(L' ');
+                buffer.append(escape_string(arg, ESCAPE_ALL));
+            }
+            parser.eval(buffer, io_chain_t());
+        }
         parser.pop_block(b);
         parser.set_last_statuses(std::move(prev_statuses));
     }
@@ -355,7 +498,7 @@ static const wchar_t *event_name_for_type(event_type_t type) {
 }
 
 void event_print(io_streams_t &streams, maybe_t<event_type_t> type_filter) {
-    event_handler_list_t tmp = *s_event_handlers.acquire();
+    event_handler_list_t tmp = s_event_handlers.acquire()->all();
     std::sort(tmp.begin(), tmp.end(),
               [](const shared_ptr<event_handler_t> &e1, const shared_ptr<event_handler_t> &e2) {
                   const event_description_t &d1 = e1->desc;
@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "common.h"
+#include "global_safety.h"
 #include "io.h"
 
 /// The process id that is used to match any process id.
@@ -72,6 +73,9 @@ struct event_handler_t {
     /// Name of the function to invoke.
     wcstring function_name{};
 
+    /// Set when the handler is removed, so that a firing already underway skips it.
+    relaxed_atomic_bool_t removed{false};
+
     explicit event_handler_t(event_type_t t) : desc(t) {}
     event_handler_t(event_description_t d, wcstring name)
         : desc(std::move(d)), function_name(std::move(name)) {}
@@ -102,6 +106,10 @@ void event_remove_function_handlers(const wcstring &name);
 /// Return all event handlers for the given function.
 event_handler_list_t event_get_function_handlers(const wcstring &name);
 
+/// Returns whether an event handler is registered for changes to the variable \p name. Changes to
+/// other variables need not construct or fire an event.
+bool event_is_variable_watched(const wcstring &name);
+
 /// Returns whether an event listener is registered for the given signal. This is safe to call from
 /// a signal handler.
 bool event_is_signal_observed(int signal);
@@ -41,10 +41,12 @@
 #include "parse_tree.h"
 #include "parser.h"
 #include "path.h"
+#include "perf_counters.h"
 #include "postfork.h"
 #include "proc.h"
 #include "reader.h"
 #include "redirection.h"
+#include "sample_profiler.h"
 #include "signal.h"
 #include "timer.h"
 #include "trace.h"
@@ -107,7 +109,7 @@ static relaxed_atomic_t<int> s_fork_count{0};
     ASSERT_IS_NOT_FORKED_CHILD();
 
     null_terminated_array_t<char> argv_array;
-    convert_wide_array_to_narrow(p->get_argv_array(), &argv_array);
+    convert_wide_array_to_narrow(p->get_argv_list(), &argv_array);
 
     auto export_vars = vars.export_arr();
     const char *const *envv = export_vars->get();
@@ -115,6 +117,10 @@ static relaxed_atomic_t<int> s_fork_count{0};
 
     // Ensure the terminal modes are what they were before we changed them.
     restore_term_mode();
+    // Stop the profiling timer, which survives the exec, and write out the samples.
+    sample_profiler_finish();
+    // Write out queued debug records, which the exec would otherwise lose.
+    flog_flush();
     // Bounce to launch_process. This never returns.
     safe_launch_process(p, actual_cmd.c_str(), argv_array.get(), envv);
 }
@@ -328,7 +334,11 @@ static bool fork_child_for_process(const std::shared_ptr<job_t> &job, process_t
     bool claim_tty = job->group->should_claim_terminal();
     pid_t fish_pgrp = claim_tty ? getpgrp() : INVALID_PID;
 
-    pid_t pid = execute_fork();
+    pid_t pid;
+    {
+        perf_timer_t timer(perf_counter_t::fork);
+        pid = execute_fork();
+    }
     if (pid == 0) {
         // This is the child process. Setup redirections, print correct output to
         // stdout and stderr, and then exit.
@@ -424,9 +434,18 @@ static bool exec_internal_builtin_proc(parser_t &parser, process_t *p, const io_
     streams.err_is_piped = (err_io != nullptr && err_io->io_mode == io_mode_t::pipe);
     streams.stdin_is_directly_redirected = stdin_is_directly_redirected;
     streams.io_chain = &proc_io_chain;
+    streams.argv_list = &p->get_argv_list();
+    streams.argv_var_spans = &p->argv_var_spans;
+
+    // The builtin may read from a pipe that `read` has looked at.
+    if (!p->builtin || p->builtin->reads_stdin) {
+        parser.libdata().read_peek.invalidate();
+    }
 
     // Note this call may block for a long time, while the builtin performs I/O.
-    p->status = builtin_run(parser, p->get_argv(), streams);
+    p->status = builtin_run(parser, p->get_argv(), streams, p->builtin);
+    streams.out.flush();
+    streams.err.flush();
     return true;  // "success"
 }
 
@@ -548,7 +567,7 @@ static bool exec_external_command(parser_t &parser, const std::shared_ptr<job_t>
     assert(p->type == process_type_t::external && "Process is not external");
     // Get argv and envv before we fork.
     null_terminated_array_t<char> argv_array;
-    convert_wide_array_to_narrow(p->get_argv_array(), &argv_array);
+    convert_wide_array_to_narrow(p->get_argv_list(), &argv_array);
 
     // Convert our IO chain to a dup2 sequence.
     auto dup2s = dup2_list_t::resolve_chain(proc_io_chain);
@@ -575,8 +594,12 @@ static bool exec_external_command(parser_t &parser, const std::shared_ptr<job_t>
         s_fork_count++;  // spawn counts as a fork+exec
 
         posix_spawner_t spawner(j.get(), dup2s);
-        maybe_t<pid_t> pid = spawner.spawn(actual_cmd, const_cast<char *const *>(argv),
-                                           const_cast<char *const *>(envv));
+        maybe_t<pid_t> pid;
+        {
+            perf_timer_t timer(perf_counter_t::fork);
+            pid = spawner.spawn(actual_cmd, const_cast<char *const *>(argv),
+                                const_cast<char *const *>(envv));
+        }
         if (int err = spawner.get_error()) {
             safe_report_exec_error(err, actual_cmd, argv, envv);
             job_mark_process_as_failed(j, p);
@@ -658,6 +681,30 @@ static void function_restore_environment(parser_t &parser, const block_t *block)
     parser.libdata().returning = false;
 }
 
+// Run the function \p props with \p argv, whose first element is the function name.
+static proc_status_t run_function(parser_t &parser, const function_properties_t &props,
+                                  const wcstring_list_t &argv, const io_chain_t &io_chain,
+                                  const job_group_ref_t &job_group) {
+    // Pull out the job list from the function.
+    const ast::job_list_t &body = props.func_node->jobs;
+    const block_t *fb = function_prepare_environment(parser, argv, props);
+    auto res = parser.eval_node(props.parsed_source, body, io_chain, job_group);
+    function_restore_environment(parser, fb);
+
+    // If the function did not execute anything, treat it as success.
+    if (res.was_empty) {
+        res = proc_status_t::from_exit_code(EXIT_SUCCESS);
+    }
+    return res.status;
+}
+
+maybe_t<proc_status_t> exec_function(parser_t &parser, const wcstring_list_t &argv) {
+    assert(!argv.empty() && "Missing function name");
+    auto props = function_get_properties(argv.front());
+    if (!props) return none();
+    return run_function(parser, *props, argv, io_chain_t{}, nullptr);
+}
+
 // The "performer" function of a block or function process.
 // This accepts a place to execute as \p parser, and a parent job as \p parent, and then executes
 // the result, returning a status.
@@ -690,19 +737,9 @@ static proc_performer_t get_performer_for_process(process_t *p, job_t *job,
             FLOGF(error, _(L"Unknown function '%ls'"), p->argv0());
             return proc_performer_t{};
         }
-        auto argv = move_to_sharedptr(p->get_argv_array().to_list());
+        auto argv = std::make_shared<wcstring_list_t>(p->get_argv_list());
         return [=](parser_t &parser) {
-            // Pull out the job list from the function.
-            const ast::job_list_t &body = props->func_node->jobs;
-            const block_t *fb = function_prepare_environment(parser, *argv, *props);
-            auto res = parser.eval_node(props->parsed_source, body, io_chain, job_group);
-            function_restore_environment(parser, fb);
-
-            // If the function did not execute anything, treat it as success.
-            if (res.was_empty) {
-                res = proc_status_t::from_exit_code(EXIT_SUCCESS);
-            }
-            return res.status;
+            return run_function(parser, *props, *argv, io_chain, job_group);
         };
     }
 }
@@ -791,7 +828,7 @@ static bool exec_process_in_job(parser_t &parser, process_t *p, const std::share
     // Maybe trace this process.
     // TODO: 'and' and 'or' will not show.
     if (trace_enabled(parser)) {
-        trace_argv(parser, nullptr, p->get_argv_array().to_list());
+        trace_argv(parser, nullptr, p->get_argv_list());
     }
 
     // The IO chain for this process.
@@ -884,6 +921,8 @@ static bool exec_process_in_job(parser_t &parser, process_t *p, const std::share
         }
 
         case process_type_t::external: {
+            // The process may read from a pipe that `read` has looked at.
+            parser.libdata().read_peek.invalidate();
             if (!exec_external_command(parser, j, p, process_net_io_chain)) {
                 return false;
             }
@@ -959,6 +998,10 @@ bool exec_job(parser_t &parser, const shared_ptr<job_t> &j, const io_chain_t &bl
         return true;
     }
 
+    // Builtins which are still running (e.g. eval, or a builtin firing an event) may have output
+    // that has not been written yet. It must come before anything this job writes.
+    fd_output_stream_t::flush_all();
+
     // Get the list of all FDs so we can ensure our pipes do not conflict.
     fd_set_t conflicts = block_io.fd_set();
     for (const auto &p : j->processes) {
@@ -19,6 +19,11 @@
 __warn_unused bool exec_job(parser_t &parser, const std::shared_ptr<job_t> &j,
                             const io_chain_t &block_io);
 
+/// Call the fish function named by argv[0] with the rest of \p argv as its arguments, without
+/// parsing a command line for it. \return the function's status, or none() if no such function is
+/// loaded. This does not autoload.
+maybe_t<proc_status_t> exec_function(parser_t &parser, const wcstring_list_t &argv);
+
 /// Evaluate a command.
 ///
 /// \param cmd the command to execute
@@ -593,8 +593,12 @@ static expand_result_t expand_braces(wcstring &&instr, expand_flags_t flags, com
 
 /// Expand a command substitution \p input, executing on \p ctx, and inserting the results into
 /// \p out_list, or any errors into \p errors. \return an expand result.
+/// If \p out_literal is set and the input is nothing but a command substitution, the output items
+/// are not escaped; instead they are moved to \p out_list as they are and *out_literal is set to
+/// true. They need no further expansion.
 static expand_result_t expand_cmdsubst(wcstring input, const operation_context_t &ctx,
-                                       completion_list_t *out_list, parse_error_list_t *errors) {
+                                       completion_list_t *out_list, parse_error_list_t *errors,
+                                       bool *out_literal = nullptr) {
     assert(ctx.parser && "Cannot expand without a parser");
     size_t cursor = 0;
     size_t paren_begin = 0;
@@ -669,6 +673,16 @@ static expand_result_t expand_cmdsubst(wcstring input, const operation_context_t
         sub_res = std::move(sub_res2);
     }
 
+    // The common case of a word that is just a command substitution, like `set x (seq 100)`.
+    if (out_literal && paren_begin == 0 && tail_begin == input.size()) {
+        out_list->reserve(out_list->size() + sub_res.size());
+        for (wcstring &sub_item : sub_res) {
+            append_completion(out_list, std::move(sub_item));
+        }
+        *out_literal = true;
+        return expand_result_t::ok;
+    }
+
     // Recursively call ourselves to expand any remaining command substitutions. The result of this
     // recursive call using the tail of the string is inserted into the tail_expand array list
     completion_list_t tail_expand;
@@ -867,6 +881,10 @@ class expander_t {
     /// List to receive any errors generated during expansion, or null to ignore errors.
     parse_error_list_t *const errors;
 
+    /// Set if the command substitution stage produced the final, literal strings, so the later
+    /// stages are skipped.
+    bool cmdsubst_literal{false};
+
     /// An expansion stage is a member function pointer.
     /// It accepts the input string (transferring ownership) and returns the list of output
     /// completions by reference. It may return an error, which halts expansion.
@@ -903,7 +921,9 @@ expand_result_t expander_t::stage_cmdsubst(wcstring input, completion_list_t *ou
         }
     } else {
         assert(ctx.parser && "Must have a parser to expand command substitutions");
-        return expand_cmdsubst(std::move(input), ctx, out, errors);
+        // Completions still want to treat the output as a path to complete.
+        bool *out_literal = (flags & expand_flag::for_completions) ? nullptr : &cmdsubst_literal;
+        return expand_cmdsubst(std::move(input), ctx, out, errors, out_literal);
     }
 }
 
@@ -1079,7 +1099,7 @@ expand_result_t expander_t::expand_string(wcstring input, completion_list_t *out
         // Output becomes our next stage's input.
         completions.swap(output_storage);
         output_storage.clear();
-        if (total_result == expand_result_t::error) {
+        if (total_result == expand_result_t::error || expand.cmdsubst_literal) {
             break;
         }
     }
@@ -3,6 +3,8 @@
 
 #include "fd_monitor.h"
 
+#include <thread>
+
 #include "flog.h"
 #include "io.h"
 #include "iothread.h"
@@ -37,6 +37,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #include <string>
 #include <vector>
 
+#include "autoload.h"
 #include "builtin.h"
 #include "common.h"
 #include "env.h"
@@ -50,10 +51,12 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #include "history.h"
 #include "intern.h"
 #include "io.h"
+#include "iothread.h"
 #include "parser.h"
 #include "path.h"
 #include "proc.h"
 #include "reader.h"
+#include "sample_profiler.h"
 #include "signal.h"
 #include "wcstringutil.h"
 #include "wutil.h"  // IWYU pragma: keep
@@ -65,8 +68,13 @@ class fish_cmd_opts_t {
     wcstring features;
     // File path for debug output.
     std::string debug_output;
+    // Whether debug output is written as JSON records.
+    bool debug_json{false};
     // File path for profiling output, or empty for none.
     std::string profile_output;
+    // File paths for the sampling profiler's folded stacks and report, or empty for none.
+    std::string profile_sample_output;
+    std::string profile_sample_report_output;
     // Commands to be executed in place of interactive shell.
     std::vector<std::string> batch_cmds;
     // Commands to execute after the shell's config has been read.
@@ -266,6 +274,7 @@ static int fish_parse_opt(int argc, char **argv, fish_cmd_opts_t *opts) {
         {"features", required_argument, nullptr, 'f'},
         {"debug", required_argument, nullptr, 'd'},
         {"debug-output", required_argument, nullptr, 'o'},
+        {"debug-format", required_argument, nullptr, 5},
         {"debug-stack-frames", required_argument, nullptr, 'D'},
         {"interactive", no_argument, nullptr, 'i'},
         {"login", no_argument, nullptr, 'l'},
@@ -273,6 +282,8 @@ static int fish_parse_opt(int argc, char **argv, fish_cmd_opts_t *opts) {
         {"print-rusage-self", no_argument, nullptr, 1},
         {"print-debug-categories", no_argument, nullptr, 2},
         {"profile", required_argument, nullptr, 'p'},
+        {"profile-sample", required_argument, nullptr, 3},
+        {"profile-sample-report", required_argument, nullptr, 4},
         {"private", no_argument, nullptr, 'P'},
         {"help", no_argument, nullptr, 'h'},
         {"version", no_argument, nullptr, 'v'},
@@ -351,6 +362,26 @@ static int fish_parse_opt(int argc, char **argv, fish_cmd_opts_t *opts) {
                 }
                 exit(0);
             }
+            case 3: {
+                opts->profile_sample_output = optarg;
+                break;
+            }
+            case 4: {
+                opts->profile_sample_report_output = optarg;
+                break;
+            }
+            case 5: {
+                if (!strcmp(optarg, "json")) {
+                    opts->debug_json = true;
+                } else if (!strcmp(optarg, "text")) {
+                    opts->debug_json = false;
+                } else {
+                    std::fwprintf(stderr, _(L"Invalid value '%s' for debug-format flag\n"),
+                                  optarg);
+                    exit(1);
+                }
+                break;
+            }
             case 'p': {
                 opts->profile_output = optarg;
                 g_profiling_active = true;
@@ -400,6 +431,23 @@ static int fish_parse_opt(int argc, char **argv, fish_cmd_opts_t *opts) {
     return optind;
 }
 
+/// If fish_autoload_preload is set to a number of seconds, preload the files the last interactive
+/// session autoloaded early on, and record the ones this session autoloads in that many seconds.
+static void start_autoload_preload() {
+    if (session_interactivity() == session_interactivity_t::not_interactive) return;
+    auto var = env_stack_t::globals().get(L"fish_autoload_preload");
+    if (var.missing_or_empty()) return;
+    int seconds = fish_wcstoi(var->as_string().c_str());
+    if (errno || seconds <= 0) return;
+    wcstring data_dir;
+    if (!path_get_data(data_dir)) return;
+    // Private sessions use the manifest, but do not replace it.
+    autoload_preload_start(data_dir + L"/autoload_preload", in_private_mode() ? 0 : seconds);
+    // Test-only, documented in CONTRIBUTING.rst: finish preloading before running anything, so
+    // the preloaded files are always used.
+    if (getenv("FISH_AUTOLOAD_PRELOAD_WAIT")) iothread_drain_all();
+}
+
 int main(int argc, char **argv) {
     int res = 1;
     int my_optind = 0;
@@ -435,6 +483,9 @@ int main(int argc, char **argv) {
         setlinebuf(debug_output);
         set_flog_output_file(debug_output);
     }
+    if (opts.debug_json) {
+        set_flog_output_json(debug_output ? fileno(debug_output) : STDERR_FILENO);
+    }
 
     // No-exec is prohibited when in interactive mode.
     if (opts.is_interactive_session && opts.no_exec) {
@@ -443,6 +494,9 @@ int main(int argc, char **argv) {
     }
 
     // Apply our options.
+    if (!opts.profile_sample_output.empty() || !opts.profile_sample_report_output.empty()) {
+        sample_profiler_start(opts.profile_sample_output, opts.profile_sample_report_output);
+    }
     if (opts.is_login) mark_login();
     if (opts.no_exec) mark_no_exec();
     if (opts.is_interactive_session) set_interactive_session(session_interactivity_t::explicit_);
@@ -466,6 +520,7 @@ int main(int argc, char **argv) {
         }
     }
     mutable_fish_features().set_from_string(opts.features);
+    start_autoload_preload();
     proc_init();
     builtin_init();
     misc_init();
@@ -533,11 +588,14 @@ int main(int argc, char **argv) {
     if (g_profiling_active) {
         parser.emit_profiling(opts.profile_output.c_str());
     }
+    sample_profiler_finish();
 
+    autoload_preload_finish();
     history_save_all();
     if (opts.print_rusage_self) {
         print_rusage_self(stderr);
     }
+    flog_flush();
     if (debug_output) {
         fclose(debug_output);
     }
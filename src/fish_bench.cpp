@@ -0,0 +1,366 @@
+// Microbenchmarks for fish's core routines.
+//
+// Each benchmark times one small operation, like tokenizing a script or matching a wildcard. The
+// operation is first run for a warmup period, then in batches long enough for the clock to time
+// accurately, and the per-operation time of each batch is reported as percentiles.
+//
+// Usage: fish_bench [--time=SECONDS] [--list] [name ...]
+// Names select the benchmarks whose names contain any of them.
+#include "config.h"  // IWYU pragma: keep
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cwchar>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+#include "builtin.h"
+#include "common.h"
+#include "env.h"
+#include "expand.h"
+#include "fallback.h"  // IWYU pragma: keep
+#include "history.h"
+#include "history_file.h"
+#include "lru.h"
+#include "operation_context.h"
+#include "proc.h"
+#include "tokenizer.h"
+#include "wildcard.h"
+#include "wutil.h"  // IWYU pragma: keep
+
+namespace {
+using bench_clock_t = std::chrono::steady_clock;
+
+/// How long to run each benchmark before measuring.
+constexpr double kWarmupSeconds = 0.1;
+
+/// The minimum length of a batch. Batches are timed as a whole, so that the clock's resolution
+/// and the cost of reading it do not matter.
+constexpr double kMinBatchSeconds = 0.001;
+
+/// Results are stored here, so that the compiler cannot drop the work that computes them.
+volatile size_t g_sink;
+
+void consume(size_t value) { g_sink = g_sink + value; }
+
+struct benchmark_t {
+    const char *name;
+    /// Performs the operation once.
+    std::function<void()> op;
+};
+
+double seconds_since(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+/// \return the p'th percentile of sorted \p values.
+double percentile(const std::vector<double> &values, double p) {
+    assert(!values.empty());
+    size_t idx = static_cast<size_t>(p / 100 * (values.size() - 1) + 0.5);
+    return values.at(idx);
+}
+
+/// Format a time in nanoseconds with a sensible unit.
+wcstring format_time(double ns) {
+    if (ns < 1e3) return format_string(L"%.1f ns", ns);
+    if (ns < 1e6) return format_string(L"%.2f us", ns / 1e3);
+    if (ns < 1e9) return format_string(L"%.2f ms", ns / 1e6);
+    return format_string(L"%.2f s", ns / 1e9);
+}
+
+/// Run a benchmark for about \p seconds and print its percentiles.
+void run_benchmark(const benchmark_t &bench, double seconds) {
+    // Warm up, and find out how many operations make a batch.
+    size_t ops = 0;
+    auto start = bench_clock_t::now();
+    do {
+        bench.op();
+        ops++;
+    } while (seconds_since(start) < kWarmupSeconds);
+    double estimate = seconds_since(start) / ops;
+    size_t batch_size = std::max<size_t>(1, static_cast<size_t>(kMinBatchSeconds / estimate));
+
+    // Measure, keeping the time per operation of each batch.
+    std::vector<double> per_op_ns;
+    start = bench_clock_t::now();
+    do {
+        auto batch_start = bench_clock_t::now();
+        for (size_t i = 0; i < batch_size; i++) bench.op();
+        per_op_ns.push_back(seconds_since(batch_start) * 1e9 / batch_size);
+    } while (seconds_since(start) < seconds);
+
+    std::sort(per_op_ns.begin(), per_op_ns.end());
+    std::fwprintf(stdout, L"%-24s %12ls %12ls %12ls %12ls %10lu\n", bench.name,
+                  format_time(per_op_ns.front()).c_str(),
+                  format_time(percentile(per_op_ns, 50)).c_str(),
+                  format_time(percentile(per_op_ns, 90)).c_str(),
+                  format_time(percentile(per_op_ns, 99)).c_str(),
+                  static_cast<unsigned long>(per_op_ns.size() * batch_size));
+}
+
+/// A script which exercises most of the syntax, as a stand-in for a config file.
+wcstring make_script(size_t repeats) {
+    const wchar_t *chunk =
+        L"# Set up the prompt and some abbreviations.\n"
+        L"function fish_prompt --description 'Write out the prompt'\n"
+        L"    set -l last_status $status\n"
+        L"    set -l color_cwd $fish_color_cwd\n"
+        L"    if test $last_status -ne 0; and not set -q __bench_quiet\n"
+        L"        echo -n -s (set_color red) \"[$last_status]\" (set_color normal) ' '\n"
+        L"    end\n"
+        L"    echo -n -s $USER @ (prompt_hostname) ' ' (set_color $color_cwd) (prompt_pwd)\n"
+        L"    printf '%s> ' (string repeat -n 2 \\x20)\n"
+        L"end\n"
+        L"for dir in ~/bin /usr/local/{bin,sbin} $HOME/.local/bin\n"
+        L"    contains -- $dir $PATH; or set -gx PATH $dir $PATH 2>/dev/null\n"
+        L"end\n"
+        L"switch (uname)\n"
+        L"    case Linux Darwin\n"
+        L"        abbr -a gco 'git checkout'; abbr -a gst \"git status --short\"\n"
+        L"    case '*'\n"
+        L"        cat /etc/motd | string replace -r '^\\s+' '' >>$HOME/motd.log &\n"
+        L"end\n";
+    wcstring result;
+    for (size_t i = 0; i < repeats; i++) result.append(chunk);
+    return result;
+}
+
+/// Text with mostly ASCII and some multibyte characters.
+std::string make_utf8_text(size_t repeats) {
+    std::string result;
+    for (size_t i = 0; i < repeats; i++) {
+        result.append("/home/user/Documents/r\xc3\xa9sum\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac.txt ");
+        result.append("plain ascii words, numbers 12345 and punctuation!\n");
+    }
+    return result;
+}
+
+/// Write a history file with \p count items and return its path, or an empty string on failure.
+std::string make_history_file(size_t count) {
+    char path[] = "/tmp/fish_bench_history.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return {};
+    }
+    std::string contents;
+    for (size_t i = 0; i < count; i++) {
+        char buf[256];
+        snprintf(buf, sizeof buf,
+                 "- cmd: git commit -m \"change %lu\" -- src/file%lu.cpp\n"
+                 "  when: %lu\n"
+                 "  paths:\n"
+                 "    - src/file%lu.cpp\n",
+                 static_cast<unsigned long>(i), static_cast<unsigned long>(i % 97),
+                 static_cast<unsigned long>(1600000000 + i), static_cast<unsigned long>(i % 97));
+        contents.append(buf);
+    }
+    bool ok = write_loop(fd, contents.data(), contents.size()) >= 0;
+    close(fd);
+    if (!ok) {
+        perror("write");
+        unlink(path);
+        return {};
+    }
+    return path;
+}
+
+class bench_lru_t : public lru_cache_t<bench_lru_t, size_t> {
+   public:
+    bench_lru_t() : lru_cache_t<bench_lru_t, size_t>(1024) {}
+};
+
+/// \return all the benchmarks. Their inputs are made once, here, and shared by the runs.
+std::vector<benchmark_t> make_benchmarks(std::vector<std::string> *cleanup_paths) {
+    std::vector<benchmark_t> result;
+
+    auto script = std::make_shared<wcstring>(make_script(100));
+    result.push_back({"tokenize", [=] {
+                          tokenizer_t tok(script->c_str(), TOK_SHOW_COMMENTS);
+                          size_t count = 0;
+                          while (tok.next()) count++;
+                          consume(count);
+                      }});
+    result.push_back({"ast_parse", [=] {
+                          auto ast = ast::ast_t::parse(*script);
+                          consume(ast.errored());
+                      }});
+
+    result.push_back({"expand_string", [] {
+                          completion_list_t out;
+                          expand_flags_t flags{expand_flag::skip_cmdsubst,
+                                               expand_flag::skip_wildcards};
+                          auto ret = expand_string(L"~/src/{fish,zsh,bash}/$PATH[1]/x{1,2,3}",
+                                                   &out, flags, operation_context_t::globals());
+                          consume(out.size() + (ret == expand_result_t::ok));
+                      }});
+
+    auto names = std::make_shared<wcstring_list_t>();
+    for (int i = 0; i < 100; i++) {
+        names->push_back(format_string(L"file_%d_report.%ls", i, i % 3 ? L"txt" : L"tar.gz"));
+    }
+    result.push_back({"wildcard_match", [=] {
+                          size_t matched = 0;
+                          for (const wcstring &name : *names) {
+                              matched += wildcard_match(name, L"*.txt");
+                              matched += wildcard_match(name, L"file_?5*report.t*");
+                              matched += wildcard_match(name, L"*_*_*.tar.gz", true);
+                          }
+                          consume(matched);
+                      }});
+
+    auto utf8 = std::make_shared<std::string>(make_utf8_text(100));
+    result.push_back({"str2wcstring", [=] { consume(str2wcstring(*utf8).size()); }});
+    auto wide = std::make_shared<wcstring>(str2wcstring(*utf8));
+    result.push_back({"wcs2string", [=] { consume(wcs2string(*wide).size()); }});
+
+    auto escaped = std::make_shared<wcstring>(escape_string(*script, ESCAPE_ALL));
+    result.push_back({"escape_string", [=] {
+                          consume(escape_string(*script, ESCAPE_ALL).size());
+                      }});
+    result.push_back({"unescape_string", [=] {
+                          wcstring out;
+                          unescape_string(*escaped, &out, UNESCAPE_DEFAULT);
+                          consume(out.size());
+                      }});
+
+    result.push_back({"fish_wcwidth", [=] {
+                          int width = 0;
+                          for (wchar_t c : *wide) width += fish_wcwidth(c);
+                          for (wchar_t c = 0x3000; c < 0x3100; c++) width += fish_wcwidth(c);
+                          consume(width);
+                      }});
+
+    std::string history_path = make_history_file(10000);
+    if (!history_path.empty()) {
+        cleanup_paths->push_back(history_path);
+        int fd = open(history_path.c_str(), O_RDONLY | O_CLOEXEC);
+        std::shared_ptr<history_file_contents_t> contents;
+        if (fd >= 0) {
+            contents = history_file_contents_t::create(fd);
+            close(fd);
+        }
+        if (contents) {
+            result.push_back({"history_decode", [=] {
+                                  size_t cursor = 0, count = 0;
+                                  while (auto offset = contents->offset_of_next_item(&cursor, 0)) {
+                                      count += contents->decode_item(*offset).str().size();
+                                  }
+                                  consume(count);
+                              }});
+        }
+    }
+
+    result.push_back({"env_get", [] {
+                          const auto &vars = env_stack_t::principal();
+                          size_t found = 0;
+                          for (const wchar_t *name :
+                               {L"PATH", L"HOME", L"fish_color_cwd", L"__fish_bench_unset"}) {
+                              found += vars.get(name).has_value();
+                          }
+                          consume(found);
+                      }});
+    result.push_back({"env_set_local", [] {
+                          auto &vars = env_stack_t::principal();
+                          vars.push(true);
+                          for (int i = 0; i < 8; i++) {
+                              vars.set_one(L"__fish_bench_local", ENV_LOCAL, L"value");
+                          }
+                          vars.pop();
+                      }});
+    result.push_back({"env_snapshot", [] {
+                          auto snapshot = env_stack_t::principal().snapshot();
+                          consume(snapshot->get(L"PATH").has_value());
+                      }});
+
+    // Twice as many keys as the cache holds, looked up in a fixed pseudo-random order which favors
+    // some keys the way real workloads do: about seven in ten lookups hit, the rest miss and evict.
+    auto keys = std::make_shared<wcstring_list_t>();
+    for (int i = 0; i < 2048; i++) keys->push_back(format_string(L"key%d", i));
+    auto order = std::make_shared<std::vector<size_t>>();
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    for (int i = 0; i < 1 << 16; i++) {
+        double u = uniform(rng);
+        order->push_back(static_cast<size_t>(u * u * u * keys->size()));
+    }
+    auto cache = std::make_shared<bench_lru_t>();
+    result.push_back({"lru_cache", [=] {
+                          static size_t next = 0;
+                          const wcstring &key = keys->at(order->at(next++ % order->size()));
+                          if (size_t *value = cache->get(key)) {
+                              consume(*value);
+                          } else {
+                              cache->insert(key, next);
+                          }
+                      }});
+    return result;
+}
+
+bool should_run(const char *name, const std::vector<std::string> &filters) {
+    if (filters.empty()) return true;
+    for (const std::string &filter : filters) {
+        if (std::strstr(name, filter.c_str())) return true;
+    }
+    return false;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    double seconds = 0.5;
+    bool list_only = false;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!std::strncmp(arg, "--time=", std::strlen("--time="))) {
+            seconds = std::atof(arg + std::strlen("--time="));
+            if (seconds <= 0) {
+                std::fwprintf(stderr, L"fish_bench: invalid time '%s'\n", arg);
+                return EXIT_FAILURE;
+            }
+        } else if (!std::strcmp(arg, "--list")) {
+            list_only = true;
+        } else if (arg[0] == '-') {
+            std::fwprintf(stderr, L"Usage: fish_bench [--time=SECONDS] [--list] [name ...]\n");
+            return EXIT_FAILURE;
+        } else {
+            filters.push_back(arg);
+        }
+    }
+
+    program_name = L"fish_bench";
+    set_main_thread();
+    setup_fork_guards();
+    proc_init();
+    builtin_init();
+    env_init();
+    misc_init();
+
+    std::vector<std::string> cleanup_paths;
+    std::vector<benchmark_t> benchmarks = make_benchmarks(&cleanup_paths);
+    if (!list_only) {
+        std::fwprintf(stdout, L"%-24s %12ls %12ls %12ls %12ls %10ls\n", "benchmark", L"min", L"p50",
+                      L"p90", L"p99", L"ops");
+    }
+    for (const benchmark_t &bench : benchmarks) {
+        if (!should_run(bench.name, filters)) continue;
+        if (list_only) {
+            std::fwprintf(stdout, L"%s\n", bench.name);
+        } else {
+            run_benchmark(bench, seconds);
+        }
+    }
+    for (const std::string &path : cleanup_paths) unlink(path.c_str());
+    return EXIT_SUCCESS;
+}
@@ -25,9 +25,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #include <stdlib.h>
 #include <wctype.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
 #include <cwchar>
 #include <memory>
+#include <mutex>
 #include <stack>
 #include <string>
 #include <tuple>
@@ -41,6 +45,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
 #include "fish_version.h"
 #include "flog.h"
 #include "highlight.h"
+#include "iothread.h"
 #include "operation_context.h"
 #include "output.h"
 #include "parse_constants.h"
@@ -834,6 +839,93 @@ static std::string html_colorize(const wcstring &text,
 
 static std::string no_colorize(const wcstring &text) { return wcs2string(text); }
 
+// Types of output we support.
+enum output_type_t {
+    output_type_plain_text,
+    output_type_file,
+    output_type_ansi,
+    output_type_pygments_csv,
+    output_type_check,
+    output_type_html
+};
+
+/// A source to format, and the result of formatting it.
+struct indent_job_t {
+    /// The file to read, or null for stdin.
+    const char *path{nullptr};
+
+    /// The errno from opening the file, or 0.
+    int open_errno{0};
+
+    /// The source as read.
+    wcstring src;
+
+    /// The prettified source, or the pygments csv for output_type_pygments_csv.
+    wcstring output;
+    std::string pygments_csv;
+};
+
+/// Read and format the source for \p job. This does not touch any shared state, so it may run on
+/// any thread.
+static void run_indent_job(indent_job_t *job, output_type_t output_type, bool do_indent) {
+    if (!job->path) {
+        job->src = read_file(stdin);
+    } else {
+        FILE *fh = fopen(job->path, "r");
+        if (!fh) {
+            job->open_errno = errno;
+            return;
+        }
+        job->src = read_file(fh);
+        fclose(fh);
+    }
+
+    if (output_type == output_type_pygments_csv) {
+        job->pygments_csv = make_pygments_csv(job->src);
+    } else {
+        job->output = prettify(job->src, do_indent);
+    }
+}
+
+/// Run \p jobs on \p thread_count threads, passing each to \p emit on the main thread as soon as
+/// it and all jobs before it are done, so output is in the same order as it would be otherwise.
+template <typename Emit>
+static void run_indent_jobs_in_parallel(std::vector<indent_job_t> jobs, size_t thread_count,
+                                        output_type_t output_type, bool do_indent,
+                                        const Emit &emit) {
+    // This is shared with the threads, which are detached and may outlive us if we exit early.
+    struct shared_t {
+        std::vector<indent_job_t> jobs;
+        std::atomic<size_t> next{0};
+        std::mutex lock;
+        std::condition_variable cond;
+        std::vector<bool> done;  // protected by lock
+    };
+    auto shared = std::make_shared<shared_t>();
+    shared->jobs = std::move(jobs);
+    shared->done.resize(shared->jobs.size(), false);
+
+    for (size_t i = 0; i < thread_count; i++) {
+        make_detached_pthread([=] {
+            size_t idx;
+            while ((idx = shared->next.fetch_add(1)) < shared->jobs.size()) {
+                run_indent_job(&shared->jobs.at(idx), output_type, do_indent);
+                std::lock_guard<std::mutex> locker(shared->lock);
+                shared->done.at(idx) = true;
+                shared->cond.notify_all();
+            }
+        });
+    }
+
+    for (size_t idx = 0; idx < shared->jobs.size(); idx++) {
+        {
+            std::unique_lock<std::mutex> locker(shared->lock);
+            while (!shared->done.at(idx)) shared->cond.wait(locker);
+        }
+        emit(shared->jobs.at(idx));
+    }
+}
+
 int main(int argc, char *argv[]) {
     program_name = L"fish_indent";
     set_main_thread();
@@ -847,19 +939,11 @@ int main(int argc, char *argv[]) {
     setlocale(LC_ALL, "");
     env_init();
 
-    // Types of output we support.
-    enum {
-        output_type_plain_text,
-        output_type_file,
-        output_type_ansi,
-        output_type_pygments_csv,
-        output_type_check,
-        output_type_html
-    } output_type = output_type_plain_text;
-    const char *output_location = "";
+    output_type_t output_type = output_type_plain_text;
     bool do_indent = true;
+    long jobs = 1;
 
-    const char *short_opts = "+d:hvwicD:";
+    const char *short_opts = "+d:hvwicD:j:";
     const struct option long_opts[] = {{"debug-level", required_argument, nullptr, 'd'},
                                        {"debug-stack-frames", required_argument, nullptr, 'D'},
                                        {"dump-parse-tree", no_argument, nullptr, 'P'},
@@ -871,6 +955,7 @@ int main(int argc, char *argv[]) {
                                        {"ansi", no_argument, nullptr, 2},
                                        {"pygments", no_argument, nullptr, 3},
                                        {"check", no_argument, nullptr, 'c'},
+                                       {"jobs", required_argument, nullptr, 'j'},
                                        {nullptr, 0, nullptr, 0}};
 
     int opt;
@@ -943,6 +1028,16 @@ int main(int argc, char *argv[]) {
                 }
                 break;
             }
+            case 'j': {
+                char *end;
+                errno = 0;
+                jobs = strtol(optarg, &end, 10);
+                if (jobs <= 0 || *end || errno) {
+                    std::fwprintf(stderr, _(L"Invalid value '%s' for jobs flag\n"), optarg);
+                    exit(1);
+                }
+                break;
+            }
             default: {
                 // We assume getopt_long() has already emitted a diagnostic msg.
                 exit(1);
@@ -953,38 +1048,33 @@ int main(int argc, char *argv[]) {
     argc -= optind;
     argv += optind;
 
-    int retval = 0;
+    if (argc == 0 && output_type == output_type_file) {
+        std::fwprintf(stderr,
+                      _(L"Expected file path to read/write for -w:\n\n $ %ls -w foo.fish\n"),
+                      program_name);
+        exit(1);
+    }
 
-    wcstring src;
-    for (int i = 0; i < argc || (argc == 0 && i == 0); i++) {
-        if (argc == 0 && i == 0) {
-            if (output_type == output_type_file) {
-                std::fwprintf(
-                    stderr, _(L"Expected file path to read/write for -w:\n\n $ %ls -w foo.fish\n"),
-                    program_name);
-                exit(1);
-            }
-            src = read_file(stdin);
-        } else {
-            FILE *fh = fopen(argv[i], "r");
-            if (fh) {
-                src = read_file(fh);
-                fclose(fh);
-                output_location = argv[i];
-            } else {
-                std::fwprintf(stderr, _(L"Opening \"%s\" failed: %s\n"), argv[i],
-                              std::strerror(errno));
-                exit(1);
-            }
+    // With no files, read stdin.
+    std::vector<indent_job_t> indent_jobs(argc ? argc : 1);
+    for (int i = 0; i < argc; i++) {
+        indent_jobs.at(i).path = argv[i];
+    }
+
+    int retval = 0;
+    auto emit = [&](const indent_job_t &job) {
+        if (job.open_errno) {
+            std::fwprintf(stderr, _(L"Opening \"%s\" failed: %s\n"), job.path,
+                          std::strerror(job.open_errno));
+            exit(1);
         }
 
         if (output_type == output_type_pygments_csv) {
-            std::string output = make_pygments_csv(src);
-            fputs(output.c_str(), stdout);
-            continue;
+            fputs(job.pygments_csv.c_str(), stdout);
+            return;
         }
 
-        const wcstring output_wtext = prettify(src, do_indent);
+        const wcstring &output_wtext = job.output;
 
         // Maybe colorize.
         std::vector<highlight_spec_t> colors;
@@ -999,12 +1089,12 @@ int main(int argc, char *argv[]) {
                 break;
             }
             case output_type_file: {
-                FILE *fh = fopen(output_location, "w");
+                FILE *fh = fopen(job.path, "w");
                 if (fh) {
                     std::fputws(output_wtext.c_str(), fh);
                     fclose(fh);
                 } else {
-                    std::fwprintf(stderr, _(L"Opening \"%s\" failed: %s\n"), output_location,
+                    std::fwprintf(stderr, _(L"Opening \"%s\" failed: %s\n"), job.path,
                                   std::strerror(errno));
                     exit(1);
                 }
@@ -1022,9 +1112,9 @@ int main(int argc, char *argv[]) {
                 DIE("pygments_csv should have been handled above");
             }
             case output_type_check: {
-                if (output_wtext != src) {
-                    if (argc) {
-                        std::fwprintf(stderr, _(L"%s\n"), argv[i]);
+                if (output_wtext != job.src) {
+                    if (job.path) {
+                        std::fwprintf(stderr, _(L"%s\n"), job.path);
                     }
                     retval++;
                 }
@@ -1033,6 +1123,21 @@ int main(int argc, char *argv[]) {
         }
 
         std::fputws(str2wcstring(colored_output).c_str(), stdout);
+    };
+
+    // Formatting files is independent, so it may be spread across threads. The results are still
+    // written out one at a time in order.
+    size_t thread_count = std::min(static_cast<size_t>(jobs), indent_jobs.size());
+    if (thread_count > 1) {
+        run_indent_jobs_in_parallel(std::move(indent_jobs), thread_count, output_type, do_indent,
+                                    emit);
+    } else {
+        for (indent_job_t &job : indent_jobs) {
+            run_indent_job(&job, output_type, do_indent);
+            emit(job);
+            // Release the file's contents before reading the next one.
+            job = indent_job_t{};
+        }
     }
     return retval;
 }
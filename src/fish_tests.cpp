@@ -417,6 +417,63 @@ static void test_escape_crazy() {
     }
 }
 
+/// Escaping and unescaping copy runs of plain characters in bulk. Check that they agree with the
+/// character-at-a-time paths on random strings made mostly of characters with special meanings.
+static void test_escape_fast_paths() {
+    say(L"Testing escaping fast paths");
+    wcstring pool = L"abcXYZ019_-./,:=+@ \t\n\r\x01\x1b\x7f\\'\"&$#^<>()[]{}?*|;%~éΩ☺";
+    for (wchar_t c : {wchar_t(0x1F41F), ENCODE_DIRECT_BASE, wchar_t(ENCODE_DIRECT_END - 1),
+                      wchar_t(ANY_CHAR), wchar_t(ANY_STRING), wchar_t(ANY_STRING_RECURSIVE),
+                      wchar_t(INTERNAL_SEPARATOR), wchar_t(-1)}) {
+        pool.push_back(c);
+    }
+    const escape_flags_t escape_flags[] = {0, ESCAPE_ALL, ESCAPE_ALL | ESCAPE_NO_QUOTED,
+                                           ESCAPE_NO_QUOTED | ESCAPE_NO_TILDE};
+    const unescape_flags_t unescape_flags[] = {
+        UNESCAPE_DEFAULT, UNESCAPE_SPECIAL, UNESCAPE_INCOMPLETE,
+        UNESCAPE_SPECIAL | UNESCAPE_INCOMPLETE, UNESCAPE_SPECIAL | UNESCAPE_NO_BACKSLASHES};
+
+    auto check_unescape = [&](const wcstring &input) {
+        for (unescape_flags_t flags : unescape_flags) {
+            wcstring fast, slow;
+            set_escape_fast_paths_for_testing(true);
+            bool fast_ok = unescape_string(input, &fast, flags);
+            set_escape_fast_paths_for_testing(false);
+            bool slow_ok = unescape_string(input, &slow, flags);
+            if (fast_ok != slow_ok || (fast_ok && fast != slow)) {
+                err(L"Unescaping '%ls' with flags %d gives '%ls' but the slow path gives '%ls'",
+                    input.c_str(), int(flags), fast.c_str(), slow.c_str());
+            }
+        }
+    };
+
+    for (size_t i = 0; i < ESCAPE_TEST_COUNT / 10; i++) {
+        wcstring input;
+        while (random() % ESCAPE_TEST_LENGTH) {
+            // Favor runs of letters, which take the fast paths.
+            if (random() % 2) {
+                input.append(random() % 20, L'a' + random() % 26);
+            } else {
+                input.push_back(pool.at(random() % pool.size()));
+            }
+        }
+
+        for (escape_flags_t flags : escape_flags) {
+            set_escape_fast_paths_for_testing(true);
+            wcstring fast = escape_string(input, flags);
+            set_escape_fast_paths_for_testing(false);
+            wcstring slow = escape_string(input, flags);
+            if (fast != slow) {
+                err(L"Escaping '%ls' with flags %d gives '%ls' but the slow path gives '%ls'",
+                    input.c_str(), int(flags), fast.c_str(), slow.c_str());
+            }
+            check_unescape(fast);
+        }
+        check_unescape(input);
+    }
+    set_escape_fast_paths_for_testing(true);
+}
+
 static void test_escape_quotes() {
     say(L"Testing escaping with quotes");
     // These are "raw string literals"
@@ -611,6 +668,28 @@ static void test_tokenizer() {
         }
     }
 
+    // Runs of ordinary characters are skipped in bulk. Check long tokens and comments at several
+    // starting offsets, including characters whose low bits look like separators.
+    {
+        const wcstring word = wcstring(40, L'x') + wchar_t(0x10000 | L' ') + L"Ħ" +
+                              wchar_t(-1) + L"'it''s \\' ☺'" + wcstring(20, L'y');
+        for (size_t pad = 0; pad < 20; pad++) {
+            wcstring text = wcstring(pad, L' ') + word + L" #" + word + L"\n" + word;
+            tokenizer_t t(text.c_str(), TOK_SHOW_COMMENTS);
+            auto token = t.next();
+            do_test(token && token->type == token_type_t::string);
+            do_test(token && t.text_of(*token) == word);
+            token = t.next();
+            do_test(token && token->type == token_type_t::comment);
+            do_test(token && t.text_of(*token) == L"#" + word);
+            token = t.next();
+            do_test(token && token->type == token_type_t::end);
+            token = t.next();
+            do_test(token && t.text_of(*token) == word);
+            do_test(!t.next());
+        }
+    }
+
     // Test some errors.
     {
         tokenizer_t t(L"abc\\", 0);
@@ -2833,6 +2912,21 @@ struct autoload_tester_t {
         do_test(autoload.resolve_command(L"file1", paths));
         autoload.mark_autoload_finished(L"file1");
 
+        // Files added to a directory are seen once the cached listing of it is stale.
+        do_test(!autoload.resolve_command(L"file3", paths));
+        run(L"touch %ls/file3.fish %ls/file3.txt", p2.c_str(), p2.c_str());
+        autoload.invalidate_cache();
+        do_test(autoload.resolve_command(L"file3", paths));
+        autoload.mark_autoload_finished(L"file3");
+
+        // Listing the commands checks whether the directories changed.
+        pwd_environment_t vars;
+        vars.extras[L"test_var"] = p2;
+        do_test((autoload.get_autoloadable_commands(vars) == wcstring_list_t{L"file2", L"file3"}));
+        run(L"rm %ls/file3.fish", p2.c_str());
+        run(L"touch %ls/file4.fish", p2.c_str());
+        do_test((autoload.get_autoloadable_commands(vars) == wcstring_list_t{L"file2", L"file4"}));
+
         run(L"rm -Rf %ls", p1.c_str());
         run(L"rm -Rf %ls", p2.c_str());
     }
@@ -6019,6 +6113,7 @@ int main(int argc, char **argv) {
     if (should_test_function("escape")) test_unescape_sane();
     if (should_test_function("escape")) test_escape_crazy();
     if (should_test_function("escape")) test_escape_quotes();
+    if (should_test_function("escape")) test_escape_fast_paths();
     if (should_test_function("format")) test_format();
     if (should_test_function("convert")) test_convert();
     if (should_test_function("convert_nulls")) test_convert_nulls();
@@ -3,14 +3,25 @@
 
 #include "flog.h"
 
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "common.h"
 #include "enum_set.h"
 #include "global_safety.h"
+#include "iothread.h"
 #include "parse_util.h"
 #include "wcstringutil.h"
 #include "wildcard.h"
+#include "wutil.h"  // IWYU pragma: keep
 
 namespace flog_details {
 
@@ -34,55 +45,314 @@ logger_t::logger_t() : file_(stderr) {}
 
 owning_lock<logger_t> g_logger;
 
-void logger_t::log1(const wchar_t *s) { std::fputws(s, file_); }
+void logger_t::log1(const wchar_t *s) {
+    if (buffer_) {
+        buffer_->append(wcs2string(s));
+    } else {
+        std::fputws(s, file_);
+    }
+}
 
 void logger_t::log1(const char *s) {
-    // Note glibc prohibits mixing narrow and wide I/O, so always use wide-printing functions.
-    // See #5900.
-    std::fwprintf(file_, L"%s", s);
+    if (buffer_) {
+        buffer_->append(s);
+    } else {
+        // Note glibc prohibits mixing narrow and wide I/O, so always use wide-printing functions.
+        // See #5900.
+        std::fwprintf(file_, L"%s", s);
+    }
 }
 
-void logger_t::log1(wchar_t c) { std::fputwc(c, file_); }
+void logger_t::log1(wchar_t c) {
+    if (buffer_) {
+        buffer_->append(wcs2string(wcstring(1, c)));
+    } else {
+        std::fputwc(c, file_);
+    }
+}
 
-void logger_t::log1(char c) { std::fwprintf(file_, L"%c", c); }
+void logger_t::log1(char c) {
+    if (buffer_) {
+        buffer_->push_back(c);
+    } else {
+        std::fwprintf(file_, L"%c", c);
+    }
+}
 
-void logger_t::log1(int64_t v) { std::fwprintf(file_, L"%lld", v); }
+void logger_t::log1(int64_t v) {
+    if (buffer_) {
+        buffer_->append(std::to_string(v));
+    } else {
+        std::fwprintf(file_, L"%lld", v);
+    }
+}
 
-void logger_t::log1(uint64_t v) { std::fwprintf(file_, L"%llu", v); }
+void logger_t::log1(uint64_t v) {
+    if (buffer_) {
+        buffer_->append(std::to_string(v));
+    } else {
+        std::fwprintf(file_, L"%llu", v);
+    }
+}
 
-void logger_t::log_fmt(const category_t &cat, const wchar_t *fmt, ...) {
-    va_list va;
-    va_start(va, fmt);
+/// Format a narrow printf-style string. \return false on error.
+static bool format_narrow(std::string *out, const char *fmt, va_list va) {
+    va_list va2;
+    va_copy(va2, va);
+    int ret = vsnprintf(nullptr, 0, fmt, va2);
+    va_end(va2);
+    if (ret < 0) {
+        perror("vsnprintf");
+        return false;
+    }
+    size_t len = static_cast<size_t>(ret) + 1;
+    std::unique_ptr<char[]> buff(new char[len]);
+    ret = vsnprintf(buff.get(), len, fmt, va);
+    if (ret < 0) {
+        perror("vsnprintf");
+        return false;
+    }
+    out->append(buff.get());
+    return true;
+}
+
+void logger_t::log_fmt(const category_t &cat, const wchar_t *fmt, va_list va) {
     log1(cat.name);
     log1(L": ");
     std::vfwprintf(file_, fmt, va);
     log1(L'\n');
-    va_end(va);
 }
 
-void logger_t::log_fmt(const category_t &cat, const char *fmt, ...) {
+void logger_t::log_fmt(const category_t &cat, const char *fmt, va_list va) {
     // glibc dislikes mixing wide and narrow output functions.
     // So construct a narrow string in-place and output that via wide functions.
+    std::string msg;
+    if (!format_narrow(&msg, fmt, va)) return;
+    log1(cat.name);
+    log1(L": ");
+    log1(msg.c_str());
+    log1(L'\n');
+}
+
+void log_fmt(const category_t &cat, const wchar_t *fmt, ...) {
     va_list va;
     va_start(va, fmt);
-    int ret = vsnprintf(nullptr, 0, fmt, va);
-    va_end(va);
-
-    if (ret < 0) {
-        perror("vsnprintf");
-        return;
+    if (g_structured_output) {
+        log_structured(cat.name, wcs2string(vformat_string(fmt, va)));
+    } else {
+        g_logger.acquire()->log_fmt(cat, fmt, va);
     }
-    size_t len = static_cast<size_t>(ret) + 1;
-    std::unique_ptr<char[]> buff(new char[len]);
+    va_end(va);
+}
 
+void log_fmt(const category_t &cat, const char *fmt, ...) {
+    va_list va;
     va_start(va, fmt);
-    ret = vsnprintf(buff.get(), len, fmt, va);
+    if (g_structured_output) {
+        std::string msg;
+        if (format_narrow(&msg, fmt, va)) log_structured(cat.name, msg);
+    } else {
+        g_logger.acquire()->log_fmt(cat, fmt, va);
+    }
     va_end(va);
-    if (ret < 0) {
-        perror("vsnprintf");
+}
+
+relaxed_atomic_bool_t g_structured_output{false};
+
+namespace {
+/// A buffer of formatted records, written by one thread and drained by the writer thread.
+/// Positions only ever increase; the byte for position p is at p % capacity.
+class record_ring_t {
+    static constexpr size_t capacity = 256 * 1024;
+    char storage_[capacity];
+
+    /// Where the owning thread writes the next record.
+    std::atomic<uint64_t> head_{0};
+    /// Where the writer reads next.
+    std::atomic<uint64_t> tail_{0};
+
+   public:
+    /// The thread which writes to this ring.
+    const uint64_t owner = thread_id();
+
+    /// Number of records which did not fit.
+    std::atomic<uint64_t> dropped{0};
+
+    /// Set when the owning thread exits, so the ring can be freed once drained.
+    std::atomic<bool> orphaned{false};
+
+    /// Append a record. Only called by the owning thread.
+    /// \return true if this filled the ring past half, so it should be drained soon.
+    bool push(const std::string &record) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        if (capacity - (head - tail) < record.size()) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        size_t start = head % capacity;
+        size_t first = std::min(record.size(), capacity - start);
+        std::memcpy(storage_ + start, record.data(), first);
+        std::memcpy(storage_, record.data() + first, record.size() - first);
+        head_.store(head + record.size(), std::memory_order_release);
+        return head - tail < capacity / 2 && head + record.size() - tail >= capacity / 2;
+    }
+
+    /// Move all complete records to \p out. Only called by the writer.
+    void drain(std::string *out) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        uint64_t head = head_.load(std::memory_order_acquire);
+        for (uint64_t pos = tail; pos < head;) {
+            size_t start = pos % capacity;
+            size_t len = std::min<uint64_t>(head - pos, capacity - start);
+            out->append(storage_ + start, len);
+            pos += len;
+        }
+        tail_.store(head, std::memory_order_release);
+    }
+};
+
+/// The structured sink: the rings of all threads that logged, and where to write them.
+struct structured_sink_t {
+    /// Protects rings. This is only held briefly, never while writing, so that a thread logging
+    /// for the first time does not wait on a slow debug output.
+    std::mutex lock;
+    /// The writer waits on this between drains. Threads whose ring is filling up signal it.
+    std::condition_variable tick;
+    std::vector<std::unique_ptr<record_ring_t>> rings;
+    /// Held while draining and writing, so that drains reach the fd in order.
+    std::mutex write_lock;
+    int fd{-1};
+
+    /// Move the records of every ring to \p out, freeing rings of exited threads. Requires lock
+    /// to be held.
+    void collect_locked(std::string *out) {
+        for (auto iter = rings.begin(); iter != rings.end();) {
+            record_ring_t &ring = **iter;
+            // Check orphaned first, so nothing the thread wrote before exiting is missed.
+            bool orphaned = ring.orphaned.load(std::memory_order_acquire);
+            ring.drain(out);
+            if (uint64_t dropped = ring.dropped.exchange(0, std::memory_order_relaxed)) {
+                out->append(format_record(L"flog", "dropped " + std::to_string(dropped) +
+                                                       " records from thread " +
+                                                       std::to_string(ring.owner)));
+            }
+            iter = orphaned ? rings.erase(iter) : iter + 1;
+        }
+    }
+
+    /// Drain every ring to the fd.
+    void drain() {
+        std::lock_guard<std::mutex> writing(write_lock);
+        std::string out;
+        {
+            std::lock_guard<std::mutex> locker(lock);
+            collect_locked(&out);
+        }
+        const char *cursor = out.data();
+        size_t remaining = out.size();
+        while (remaining > 0) {
+            ssize_t amt = write(fd, cursor, remaining);
+            if (amt < 0 && errno == EINTR) continue;
+            if (amt <= 0) break;
+            cursor += amt;
+            remaining -= amt;
+        }
+    }
+
+    /// Format a record as a line of JSON.
+    static std::string format_record(const wchar_t *category, const std::string &msg);
+};
+
+structured_sink_t *const s_structured_sink = new structured_sink_t();
+
+/// How long the writer waits between drains.
+constexpr auto flog_writer_interval = std::chrono::milliseconds(20);
+
+/// The key holding each thread's ring. Its destructor marks the ring orphaned.
+pthread_key_t s_ring_key;
+
+/// \return the length of the valid UTF-8 sequence at the start of \p s, or 0 if there is none.
+size_t utf8_sequence_length(const unsigned char *s, size_t len) {
+    unsigned char c = s[0];
+    size_t count;
+    uint32_t min, cp;
+    if (c < 0x80) return 1;
+    if ((c & 0xE0) == 0xC0) {
+        count = 2, min = 0x80, cp = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        count = 3, min = 0x800, cp = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        count = 4, min = 0x10000, cp = c & 0x07;
+    } else {
+        return 0;
+    }
+    if (count > len) return 0;
+    for (size_t i = 1; i < count; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 0;
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    // Reject overlong forms, surrogates and code points past the end of Unicode.
+    if (cp < min || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) return 0;
+    return count;
+}
+
+/// Append \p s to \p out as the contents of a JSON string. Bytes which are not valid UTF-8, such
+/// as those of a file name in another encoding, are escaped as if they were Latin-1, so the output
+/// is always valid JSON.
+void append_json_string(std::string *out, const std::string &s) {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(s.data());
+    size_t len = s.size();
+    for (size_t i = 0; i < len;) {
+        unsigned char c = bytes[i];
+        size_t seq = utf8_sequence_length(bytes + i, len - i);
+        if (c == '"' || c == '\\') {
+            out->push_back('\\');
+            out->push_back(c);
+        } else if (c < 0x20 || seq == 0) {
+            char escape[8];
+            snprintf(escape, sizeof escape, "\\u%04x", static_cast<unsigned>(c));
+            out->append(escape);
+        } else {
+            out->append(s, i, seq);
+            i += seq;
+            continue;
+        }
+        i++;
+    }
+}
+
+std::string structured_sink_t::format_record(const wchar_t *category, const std::string &msg) {
+    std::string result = "{\"time\":";
+    char time[32];
+    snprintf(time, sizeof time, "%.6f", timef());
+    result.append(time);
+    result.append(",\"thread\":");
+    result.append(std::to_string(thread_id()));
+    result.append(",\"category\":\"");
+    append_json_string(&result, wcs2string(category));
+    result.append("\",\"message\":\"");
+    append_json_string(&result, msg);
+    result.append("\"}\n");
+    return result;
+}
+}  // namespace
+
+void log_structured(const wchar_t *category, const std::string &msg) {
+    std::string record = structured_sink_t::format_record(category, msg);
+    // The writer thread did not survive a fork, so a child writes directly.
+    if (is_forked_child()) {
+        ignore_result(write(s_structured_sink->fd, record.data(), record.size()));
         return;
     }
-    log_fmt(cat, L"%s", buff.get());
+    auto *ring = static_cast<record_ring_t *>(pthread_getspecific(s_ring_key));
+    if (!ring) {
+        ring = new record_ring_t();
+        pthread_setspecific(s_ring_key, ring);
+        std::lock_guard<std::mutex> locker(s_structured_sink->lock);
+        s_structured_sink->rings.emplace_back(ring);
+    }
+    if (ring->push(record)) s_structured_sink->tick.notify_one();
 }
 
 }  // namespace flog_details
@@ -119,7 +389,41 @@ void activate_flog_categories_by_pattern(const wcstring &inwc) {
 
 void set_flog_output_file(FILE *f) { g_logger.acquire()->set_file(f); }
 
-void log_extra_to_flog_file(const wcstring &s) { g_logger.acquire()->log_extra(s.c_str()); }
+void set_flog_output_json(int fd) {
+    assert(!g_structured_output && "Structured output already set");
+    pthread_key_create(&s_ring_key, [](void *ring) {
+        static_cast<record_ring_t *>(ring)->orphaned.store(true, std::memory_order_release);
+    });
+    s_structured_sink->fd = fd;
+    make_detached_pthread([] {
+        structured_sink_t *sink = s_structured_sink;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> locker(sink->lock);
+                sink->tick.wait_for(locker, flog_writer_interval);
+            }
+            sink->drain();
+        }
+    });
+    g_structured_output = true;
+}
+
+void flog_flush() {
+    // A forked child writes directly, and the rings it inherited hold its parent's records.
+    if (!g_structured_output || is_forked_child()) return;
+    s_structured_sink->drain();
+}
+
+void log_extra_to_flog_file(const wcstring &s) {
+    if (g_structured_output) {
+        // Tracing hands us whole lines, but records have no trailing newline.
+        wcstring line = s;
+        if (!line.empty() && line.back() == L'\n') line.pop_back();
+        log_structured(L"trace", wcs2string(line));
+    } else {
+        g_logger.acquire()->log_extra(s.c_str());
+    }
+}
 
 std::vector<const category_t *> get_flog_categories() {
     std::vector<const category_t *> result(s_all_categories.begin(), s_all_categories.end());
@@ -4,6 +4,7 @@
 
 #include "config.h"  // IWYU pragma: keep
 
+#include <stdarg.h>
 #include <stdio.h>
 
 #include <string>
@@ -101,14 +102,17 @@ class category_list_t {
     category_t reader{L"reader", L"The interactive reader/input system"};
     category_t complete{L"complete", L"The completion system"};
     category_t path{L"path", L"Searching/using paths"};
+    category_t autoload{L"autoload", L"Preloading autoloaded files"};
 
     category_t screen{L"screen", L"Screen repaints"};
 };
 
 /// The class responsible for logging.
 /// This is protected by a lock.
+/// It can also format a single record's message into a string, for the structured sink.
 class logger_t {
     FILE *file_;
+    std::string *buffer_{nullptr};
 
     void log1(const wchar_t *);
     void log1(const char *);
@@ -147,6 +151,15 @@ class logger_t {
 
     logger_t();
 
+    /// Construct a logger which appends the messages of records to \p buffer.
+    explicit logger_t(std::string *buffer) : file_(nullptr), buffer_(buffer) {}
+
+    /// Append just the message of a record, without category or newline.
+    template <typename... Args>
+    void log_message(const Args &... args) {
+        log_args_impl(args...);
+    }
+
     template <typename... Args>
     void log_args(const category_t &cat, const Args &... args) {
         log1(cat.name);
@@ -155,8 +168,8 @@ class logger_t {
         log1('\n');
     }
 
-    void log_fmt(const category_t &cat, const wchar_t *fmt, ...);
-    void log_fmt(const category_t &cat, const char *fmt, ...);
+    void log_fmt(const category_t &cat, const wchar_t *fmt, va_list va);
+    void log_fmt(const category_t &cat, const char *fmt, va_list va);
 
     // Log outside of the usual flog usage.
     void log_extra(const wchar_t *s) { log1(s); }
@@ -164,6 +177,26 @@ class logger_t {
 
 extern owning_lock<logger_t> g_logger;
 
+/// Set if records go to the structured sink, see set_flog_output_json().
+extern relaxed_atomic_bool_t g_structured_output;
+
+/// Queue a record with the given category name and message for the structured sink.
+void log_structured(const wchar_t *category, const std::string &msg);
+
+template <typename... Args>
+void log_args(const category_t &cat, const Args &... args) {
+    if (g_structured_output) {
+        std::string msg;
+        logger_t(&msg).log_message(args...);
+        log_structured(cat.name, msg);
+    } else {
+        g_logger.acquire()->log_args(cat, args...);
+    }
+}
+
+void log_fmt(const category_t &cat, const wchar_t *fmt, ...);
+void log_fmt(const category_t &cat, const char *fmt, ...);
+
 }  // namespace flog_details
 
 /// Set the active flog categories according to the given wildcard \p wc.
@@ -173,6 +206,16 @@ void activate_flog_categories_by_pattern(const wcstring &wc);
 /// flog does not close this file.
 void set_flog_output_file(FILE *f);
 
+/// Switch flog to structured output: one JSON object per line, with the time, thread id, category
+/// and message of each record. Records are queued in per-thread buffers without locking, and a
+/// background thread writes them to \p fd without holding the lock that threads take to register
+/// their buffer. If a thread logs faster than they are written, records
+/// are dropped and the number dropped is logged.
+void set_flog_output_json(int fd);
+
+/// Write out any queued structured records. Call this before exiting or exec'ing.
+void flog_flush();
+
 /// \return a list of all categories, sorted by name.
 std::vector<const flog_details::category_t *> get_flog_categories();
 
@@ -182,25 +225,23 @@ void log_extra_to_flog_file(const wcstring &s);
 
 /// Output to the fish log a sequence of arguments, separated by spaces, and ending with a newline.
 /// We save and restore errno because we don't want this to affect other code.
-#define FLOG(wht, ...)                                                        \
-    do {                                                                      \
-        if (flog_details::category_list_t::g_instance->wht.enabled) {         \
-            auto old_errno = errno;                                           \
-            flog_details::g_logger.acquire()->log_args(                       \
-                flog_details::category_list_t::g_instance->wht, __VA_ARGS__); \
-            errno = old_errno;                                                \
-        }                                                                     \
+#define FLOG(wht, ...)                                                                           \
+    do {                                                                                         \
+        if (flog_details::category_list_t::g_instance->wht.enabled) {                            \
+            auto old_errno = errno;                                                              \
+            flog_details::log_args(flog_details::category_list_t::g_instance->wht, __VA_ARGS__); \
+            errno = old_errno;                                                                   \
+        }                                                                                        \
     } while (0)
 
 /// Output to the fish log a printf-style formatted string.
-#define FLOGF(wht, ...)                                                       \
-    do {                                                                      \
-        if (flog_details::category_list_t::g_instance->wht.enabled) {         \
-            auto old_errno = errno;                                           \
-            flog_details::g_logger.acquire()->log_fmt(                        \
-                flog_details::category_list_t::g_instance->wht, __VA_ARGS__); \
-            errno = old_errno;                                                \
-        }                                                                     \
+#define FLOGF(wht, ...)                                                                         \
+    do {                                                                                        \
+        if (flog_details::category_list_t::g_instance->wht.enabled) {                           \
+            auto old_errno = errno;                                                             \
+            flog_details::log_fmt(flog_details::category_list_t::g_instance->wht, __VA_ARGS__); \
+            errno = old_errno;                                                                  \
+        }                                                                                       \
     } while (0)
 
 #endif
@@ -110,34 +110,13 @@ static void try_autoload(const wcstring &name, parser_t &parser) {
 }
 
 /// Insert a list of all dynamically loaded functions into the specified list.
-static void autoload_names(std::unordered_set<wcstring> &names, int get_hidden) {
-    size_t i;
-
+static void autoload_names(autoload_t &autoloader, std::unordered_set<wcstring> &names,
+                           int get_hidden) {
     // TODO: justfy this.
     auto &vars = env_stack_t::principal();
-    const auto path_var = vars.get(L"fish_function_path");
-    if (path_var.missing_or_empty()) return;
-
-    wcstring_list_t path_list;
-    path_var->to_list(path_list);
-
-    for (i = 0; i < path_list.size(); i++) {
-        const wcstring &ndir_str = path_list.at(i);
-        dir_t dir(ndir_str);
-        if (!dir.valid()) continue;
-
-        wcstring name;
-        while (dir.read(name)) {
-            const wchar_t *fn = name.c_str();
-            const wchar_t *suffix;
-            if (!get_hidden && fn[0] == L'_') continue;
-
-            suffix = std::wcsrchr(fn, L'.');
-            if (suffix && (std::wcscmp(suffix, L".fish") == 0)) {
-                wcstring name(fn, suffix - fn);
-                names.insert(name);
-            }
-        }
+    for (wcstring &name : autoloader.get_autoloadable_commands(vars)) {
+        if (!get_hidden && !name.empty() && name.at(0) == L'_') continue;
+        names.insert(std::move(name));
     }
 }
 
@@ -278,7 +257,7 @@ bool function_copy(const wcstring &name, const wcstring &new_name) {
 wcstring_list_t function_get_names(int get_hidden) {
     std::unordered_set<wcstring> names;
     auto funcset = function_set.acquire();
-    autoload_names(names, get_hidden);
+    autoload_names(funcset->autoloader, names, get_hidden);
     for (const auto &func : funcset->funcs) {
         const wcstring &name = func.first;
 
@@ -309,13 +288,10 @@ int function_get_definition_lineno(const wcstring &name) {
     if (!func) return -1;
     // return one plus the number of newlines at offsets less than the start of our function's
     // statement (which includes the header).
-    // TODO: merge with line_offset_of_character_at_offset?
     auto source_range = func->props->func_node->try_source_range();
     assert(source_range && "Function has no source range");
-    uint32_t func_start = source_range->start;
-    const wcstring &source = func->props->parsed_source->src;
-    assert(func_start <= source.size() && "function start out of bounds");
-    return 1 + std::count(source.begin(), source.begin() + func_start, L'\n');
+    const auto &source = func->props->parsed_source;
+    return 1 + static_cast<int>(source->line_offset_of_character_at_offset(source_range->start));
 }
 
 void function_invalidate_path() {
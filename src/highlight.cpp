@@ -32,6 +32,7 @@
 #include "parse_util.h"
 #include "parser.h"
 #include "path.h"
+#include "perf_counters.h"
 #include "tokenizer.h"
 #include "wcstringutil.h"
 #include "wildcard.h"
@@ -1310,6 +1311,7 @@ std::string colorize(const wcstring &text, const std::vector<highlight_spec_t> &
 
 void highlight_shell(const wcstring &buff, std::vector<highlight_spec_t> &color,
                      const operation_context_t &ctx, bool io_ok) {
+    perf_timer_t timer(perf_counter_t::highlight);
     const wcstring working_directory = ctx.vars.get_pwd_slash();
     highlighter_t highlighter(buff, ctx, working_directory, io_ok);
     color = highlighter.highlight();
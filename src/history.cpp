@@ -44,6 +44,7 @@
 #include "parse_util.h"
 #include "parser.h"
 #include "path.h"
+#include "perf_counters.h"
 #include "reader.h"
 #include "wcstringutil.h"
 #include "wildcard.h"  // IWYU pragma: keep
@@ -601,6 +602,7 @@ void history_impl_t::load_old_if_needed() {
 }
 
 bool history_search_t::go_backwards() {
+    perf_timer_t timer(perf_counter_t::history_search);
     // Backwards means increasing our index.
     const auto max_index = static_cast<size_t>(-1);
 
@@ -19,6 +19,7 @@
 #include "iothread.h"
 #include "path.h"
 #include "redirection.h"
+#include "wcstringutil.h"
 #include "wutil.h"  // IWYU pragma: keep
 
 /// File redirection error message.
@@ -359,14 +360,82 @@ void output_stream_t::append_with_separation(const wchar_t *s, size_t len, separ
     }
 }
 
+/// How much output an fd_output_stream_t collects before writing it.
+static constexpr size_t kFdOutputFlushSize = 16 * 1024;
+
+/// The most recently created fd output stream on this thread which collects its output. The others
+/// are reachable through its next_buffered_ link.
+/// Builtins may run other builtins and processes (eval, source, event handlers), so there may be
+/// several of these; they are flushed together so that output appears in order.
+static FISH_THREAD_LOCAL fd_output_stream_t *s_buffered_fd_streams = nullptr;
+
+fd_output_stream_t::fd_output_stream_t(int fd) : fd_(fd), buffered_(fd == STDOUT_FILENO) {
+    assert(fd_ >= 0 && "Invalid fd");
+    if (buffered_) {
+        // Output of builtins which are already running comes first.
+        flush_all();
+        line_buffered_ = isatty(fd_);
+        next_buffered_ = s_buffered_fd_streams;
+        s_buffered_fd_streams = this;
+    }
+}
+
+fd_output_stream_t::~fd_output_stream_t() {
+    if (buffered_) {
+        flush();
+        fd_output_stream_t **cursor = &s_buffered_fd_streams;
+        while (*cursor != this) {
+            assert(*cursor && "Stream not in buffered list");
+            cursor = &(*cursor)->next_buffered_;
+        }
+        *cursor = next_buffered_;
+    }
+}
+
 void fd_output_stream_t::append(const wchar_t *s, size_t amt) {
     if (errored_) return;
-    int res = wwrite_to_fd(s, amt, this->fd_);
-    if (res < 0) {
+    if (!buffered_) {
+        // Anything collected for stdout was produced before this, so write that first.
+        flush_all();
+        if (wwrite_to_fd(s, amt, this->fd_) < 0) {
+            // TODO: this error is too aggressive, e.g. if we got SIGINT we should not complain.
+            wperror(L"write");
+            errored_ = true;
+        }
+        return;
+    }
+
+    wcs2string_callback(s, amt, [this](const char *buff, size_t len) {
+        pending_.append(buff, len);
+        return true;
+    });
+    if (pending_.size() >= kFdOutputFlushSize ||
+        (line_buffered_ && std::wmemchr(s, L'\n', amt) != nullptr)) {
+        flush();
+    }
+}
+
+void fd_output_stream_t::flush() {
+    if (pending_.empty()) return;
+    if (!errored_ && write_loop(fd_, pending_.data(), pending_.size()) < 0) {
         // TODO: this error is too aggressive, e.g. if we got SIGINT we should not complain.
         wperror(L"write");
         errored_ = true;
     }
+    pending_.clear();
+}
+
+void fd_output_stream_t::flush_all() {
+    // Flush the oldest first, since its output was generated first.
+    // There are only ever a few of these, so recursion is fine.
+    struct flusher_t {
+        static void flush(fd_output_stream_t *stream) {
+            if (!stream) return;
+            flush(stream->next_buffered_);
+            stream->flush();
+        }
+    };
+    flusher_t::flush(s_buffered_fd_streams);
 }
 
 void null_output_stream_t::append(const wchar_t *, size_t) {}
@@ -5,6 +5,7 @@
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 #include <atomic>
 #include <future>
@@ -398,6 +399,34 @@ maybe_t<autoclose_pipes_t> make_autoclose_pipes(const fd_set_t &fdset);
 /// cloexec. \returns invalid fd on failure (in which case the given fd is still closed).
 autoclose_fd_t move_fd_to_unused(autoclose_fd_t fd, const fd_set_t &fdset);
 
+/// The start of a pipe's contents which `read` has copied out without consuming it, so that it can
+/// consume exactly one line per read() instead of one byte. This is owned by the parser and is only
+/// valid while nothing else reads the pipe, so it is discarded whenever a process which might is
+/// started.
+struct pipe_peek_t {
+    /// The pipe the bytes were copied from.
+    dev_t dev{};
+    ino_t ino{};
+
+    /// Bytes copied from the pipe. Those before \p consumed have been read since.
+    std::string bytes{};
+    size_t consumed{0};
+
+    /// A pipe to receive the copies, kept around between reads.
+    maybe_t<autoclose_pipes_t> scratch{};
+
+    /// \return whether we have unconsumed bytes copied from the pipe with the given identity.
+    bool is_valid_for(dev_t d, ino_t i) const {
+        return consumed < bytes.size() && dev == d && ino == i;
+    }
+
+    /// Forget the copied bytes.
+    void invalidate() {
+        bytes.clear();
+        consumed = 0;
+    }
+};
+
 /// Base class representing the output that a builtin can generate.
 /// This has various subclasses depending on the ultimate output destination.
 class output_stream_t {
@@ -437,6 +466,9 @@ class output_stream_t {
 
     void append_formatv(const wchar_t *format, va_list va) { append(vformat_string(format, va)); }
 
+    /// Write out any output held back by the stream. Most streams do not hold anything back.
+    virtual void flush() {}
+
     // No copying.
     output_stream_t(const output_stream_t &s) = delete;
     void operator=(const output_stream_t &s) = delete;
@@ -452,19 +484,40 @@ class null_output_stream_t final : public output_stream_t {
 
 /// An output stream for builtins which outputs to an fd.
 /// Note the fd may be something like stdout; there is no ownership implied here.
+///
+/// Output to stdout is collected and written in large blocks: when enough has accumulated, at a
+/// newline if stdout is a tty, when the builtin finishes, and before anything else may write to the
+/// same place or wait for input (see flush_all()). Output to other fds is written immediately.
 class fd_output_stream_t final : public output_stream_t {
    public:
     /// Construct from a file descriptor, which must be nonegative.
-    explicit fd_output_stream_t(int fd) : fd_(fd) { assert(fd_ >= 0 && "Invalid fd"); }
+    explicit fd_output_stream_t(int fd);
+    ~fd_output_stream_t() override;
 
     void append(const wchar_t *s, size_t amt) override;
+    void flush() override;
+
+    /// Flush all fd output streams on this thread which hold pending output.
+    static void flush_all();
 
    private:
     /// The file descriptor to write to.
     const int fd_;
 
+    /// Whether we collect output instead of writing it immediately.
+    const bool buffered_;
+
+    /// Whether we flush at every newline; this is set for ttys.
+    bool line_buffered_{false};
+
     /// Whether we have received an error.
     bool errored_{false};
+
+    /// Output not yet written.
+    std::string pending_;
+
+    /// The next older stream in this thread's list of buffered streams.
+    fd_output_stream_t *next_buffered_{nullptr};
 };
 
 /// An output stream for builtins which buffers into a separated buffer.
@@ -488,6 +541,17 @@ class buffered_output_stream_t final : public output_stream_t {
     separated_buffer_t<wcstring> buffer_;
 };
 
+/// A run of a builtin's arguments which came from expanding a bare variable, as in
+/// `contains x $list`, so they are exactly the variable's values. Builtins may search such a run
+/// through the variable.
+struct argv_var_span_t {
+    /// Index of the first argument of the run.
+    size_t start;
+    /// The variable whose values make up the run.
+    env_var_t var;
+};
+using argv_var_span_list_t = std::vector<argv_var_span_t>;
+
 struct io_streams_t {
     // Streams for out and err.
     output_stream_t &out;
@@ -513,6 +577,11 @@ struct io_streams_t {
     // Actual IO redirections. This is only used by the source builtin. Unowned.
     const io_chain_t *io_chain{nullptr};
 
+    // The arguments of the builtin as they were expanded, before any option parsing reordered
+    // them, and the runs of them which came from bare variables. Unowned, may be null.
+    const wcstring_list_t *argv_list{nullptr};
+    const argv_var_span_list_t *argv_var_spans{nullptr};
+
     // The job group of the job, if any. This enables builtins which run more code like eval() to
     // share pgid.
     // FIXME: this is awkwardly placed.
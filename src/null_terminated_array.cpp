@@ -59,17 +59,12 @@ char **make_null_terminated_array(const std::vector<std::string> &lst) {
     return make_null_terminated_array_helper(lst);
 }
 
-void convert_wide_array_to_narrow(const null_terminated_array_t<wchar_t> &wide_arr,
+void convert_wide_array_to_narrow(const wcstring_list_t &wide_arr,
                                   null_terminated_array_t<char> *output) {
-    const wchar_t *const *arr = wide_arr.get();
-    if (!arr) {
-        output->clear();
-        return;
-    }
-
     std::vector<std::string> list;
-    for (size_t i = 0; arr[i]; i++) {
-        list.push_back(wcs2string(arr[i]));
+    list.reserve(wide_arr.size());
+    for (const wcstring &arg : wide_arr) {
+        list.push_back(wcs2string(arg));
     }
     output->set(list);
 }
@@ -81,7 +81,7 @@ class null_terminated_array_t {
 
 // Helper function to convert from a null_terminated_array_t<wchar_t> to a
 // null_terminated_array_t<char_t>.
-void convert_wide_array_to_narrow(const null_terminated_array_t<wchar_t> &arr,
+void convert_wide_array_to_narrow(const wcstring_list_t &arr,
                                   null_terminated_array_t<char> *output);
 
 #endif  // FISH_NULL_TERMINATED_ARRAY_H
@@ -87,25 +87,26 @@ enum class parse_keyword_t : uint8_t {
     kw_while,
 };
 
-const enum_map<parse_keyword_t> keyword_enum_map[] = {{parse_keyword_t::kw_exclam, L"!"},
-                                                      {parse_keyword_t::kw_and, L"and"},
-                                                      {parse_keyword_t::kw_begin, L"begin"},
-                                                      {parse_keyword_t::kw_builtin, L"builtin"},
-                                                      {parse_keyword_t::kw_case, L"case"},
-                                                      {parse_keyword_t::kw_command, L"command"},
-                                                      {parse_keyword_t::kw_else, L"else"},
-                                                      {parse_keyword_t::kw_end, L"end"},
-                                                      {parse_keyword_t::kw_exec, L"exec"},
-                                                      {parse_keyword_t::kw_for, L"for"},
-                                                      {parse_keyword_t::kw_function, L"function"},
-                                                      {parse_keyword_t::kw_if, L"if"},
-                                                      {parse_keyword_t::kw_in, L"in"},
-                                                      {parse_keyword_t::kw_not, L"not"},
-                                                      {parse_keyword_t::kw_or, L"or"},
-                                                      {parse_keyword_t::kw_switch, L"switch"},
-                                                      {parse_keyword_t::kw_time, L"time"},
-                                                      {parse_keyword_t::kw_while, L"while"},
-                                                      {parse_keyword_t::none, nullptr}};
+constexpr enum_map<parse_keyword_t> keyword_enum_map[] = {
+    {parse_keyword_t::kw_exclam, L"!"},
+    {parse_keyword_t::kw_and, L"and"},
+    {parse_keyword_t::kw_begin, L"begin"},
+    {parse_keyword_t::kw_builtin, L"builtin"},
+    {parse_keyword_t::kw_case, L"case"},
+    {parse_keyword_t::kw_command, L"command"},
+    {parse_keyword_t::kw_else, L"else"},
+    {parse_keyword_t::kw_end, L"end"},
+    {parse_keyword_t::kw_exec, L"exec"},
+    {parse_keyword_t::kw_for, L"for"},
+    {parse_keyword_t::kw_function, L"function"},
+    {parse_keyword_t::kw_if, L"if"},
+    {parse_keyword_t::kw_in, L"in"},
+    {parse_keyword_t::kw_not, L"not"},
+    {parse_keyword_t::kw_or, L"or"},
+    {parse_keyword_t::kw_switch, L"switch"},
+    {parse_keyword_t::kw_time, L"time"},
+    {parse_keyword_t::kw_while, L"while"},
+    {parse_keyword_t::none, nullptr}};
 #define keyword_enum_map_len (sizeof keyword_enum_map / sizeof *keyword_enum_map)
 
 // Statement decorations like 'command' or 'exec'.
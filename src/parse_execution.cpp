@@ -38,6 +38,7 @@
 #include "path.h"
 #include "proc.h"
 #include "reader.h"
+#include "sample_profiler.h"
 #include "timer.h"
 #include "tokenizer.h"
 #include "trace.h"
@@ -117,6 +118,17 @@ static redirection_spec_t get_stderr_merge() {
     return redirection_spec_t{STDERR_FILENO, redirection_mode_t::fd, stdout_fileno_str};
 }
 
+/// \return whether an argument is a bare variable expansion like `$foo`, which expands to exactly
+/// the variable's values, storing the variable's name in \p out_name. $history is not a variable.
+static bool is_bare_variable(const wcstring &arg, wcstring *out_name) {
+    if (arg.size() < 2 || arg.front() != L'$') return false;
+    for (size_t i = 1; i < arg.size(); i++) {
+        if (!valid_var_name_char(arg[i])) return false;
+    }
+    out_name->assign(arg, 1, wcstring::npos);
+    return *out_name != L"history";
+}
+
 parse_execution_context_t::parse_execution_context_t(parsed_source_ref_t pstree,
                                                      const operation_context_t &ctx,
                                                      io_chain_t block_io)
@@ -863,8 +875,10 @@ end_execution_reason_t parse_execution_context_t::populate_plain_process(
                         args_from_cmd_expansion.end());
 
         ast_args_list_t arg_nodes = get_argument_nodes(statement.args_or_redirs);
+        argv_var_span_list_t *var_spans =
+            process_type == process_type_t::builtin ? &proc->argv_var_spans : nullptr;
         end_execution_reason_t arg_result =
-            this->expand_arguments_from_nodes(arg_nodes, &cmd_args, glob_behavior);
+            this->expand_arguments_from_nodes(arg_nodes, &cmd_args, glob_behavior, var_spans);
         if (arg_result != end_execution_reason_t::ok) {
             return arg_result;
         }
@@ -881,7 +895,10 @@ end_execution_reason_t parse_execution_context_t::populate_plain_process(
 
     // Populate the process.
     proc->type = process_type;
-    proc->set_argv(cmd_args);
+    if (process_type == process_type_t::builtin) {
+        proc->builtin = builtin_lookup(cmd_args.front());
+    }
+    proc->set_argv(std::move(cmd_args));
     proc->set_redirection_specs(std::move(redirections));
     proc->actual_cmd = std::move(path_to_external_command);
     return end_execution_reason_t::ok;
@@ -891,16 +908,31 @@ end_execution_reason_t parse_execution_context_t::populate_plain_process(
 // have a wildcard that could not be expanded, report the error and continue.
 end_execution_reason_t parse_execution_context_t::expand_arguments_from_nodes(
     const ast_args_list_t &argument_nodes, wcstring_list_t *out_arguments,
-    globspec_t glob_behavior) {
+    globspec_t glob_behavior, argv_var_span_list_t *out_var_spans) {
     // Get all argument nodes underneath the statement. We guess we'll have that many arguments (but
     // may have more or fewer, if there are wildcards involved).
     out_arguments->reserve(out_arguments->size() + argument_nodes.size());
     completion_list_t arg_expanded;
+    wcstring var_name;
     for (const ast::argument_t *arg_node : argument_nodes) {
         // Expect all arguments to have source.
         assert(arg_node->has_source());
         const wcstring arg_str = get_source(*arg_node);
 
+        // A bare variable expands to exactly its values (or nothing, if it is unset). Skip the
+        // general expansion and remember where the values went, so builtins can search them
+        // through the variable.
+        if (is_bare_variable(arg_str, &var_name)) {
+            if (auto var = ctx.vars.get(var_name)) {
+                const wcstring_list_t &vals = var->as_list();
+                if (out_var_spans && !vals.empty()) {
+                    out_var_spans->push_back(argv_var_span_t{out_arguments->size(), *var});
+                }
+                out_arguments->insert(out_arguments->end(), vals.begin(), vals.end());
+            }
+            continue;
+        }
+
         // Expand this string.
         parse_error_list_t errors;
         arg_expanded.clear();
@@ -1234,6 +1266,11 @@ end_execution_reason_t parse_execution_context_t::run_1_job(const ast::job_t &jo
     // Save the node index.
     scoped_push<const ast::job_t *> saved_node(&executing_job_node, &job_node);
 
+    // Give the sampling profiler a chance to collect, both now and once the job is done, so that
+    // samples taken while it runs are attributed to it.
+    sample_profiler_poll(*parser);
+    cleanup_t collect_samples([&] { sample_profiler_poll(*parser); });
+
     // Profiling support.
     profile_item_t *profile_item = this->parser->create_profile_item();
     const auto start_time = profile_item ? profile_item_t::now() : 0;
@@ -1494,7 +1531,7 @@ end_execution_reason_t parse_execution_context_t::eval_node(const ast::job_list_
     return this->run_job_list(job_list, associated_block);
 }
 
-int parse_execution_context_t::line_offset_of_node(const ast::job_t *node) {
+int parse_execution_context_t::line_offset_of_node(const ast::job_t *node) const {
     // If we're not executing anything, return -1.
     if (!node) {
         return -1;
@@ -1506,44 +1543,10 @@ int parse_execution_context_t::line_offset_of_node(const ast::job_t *node) {
         return -1;
     }
 
-    return this->line_offset_of_character_at_offset(range->start);
-}
-
-int parse_execution_context_t::line_offset_of_character_at_offset(size_t offset) {
-    // Count the number of newlines, leveraging our cache.
-    assert(offset <= pstree->src.size());
-
-    // Easy hack to handle 0.
-    if (offset == 0) {
-        return 0;
-    }
-
-    // We want to return (one plus) the number of newlines at offsets less than the given offset.
-    // cached_lineno_count is the number of newlines at indexes less than cached_lineno_offset.
-    const wchar_t *str = pstree->src.c_str();
-    if (offset > cached_lineno_offset) {
-        size_t i;
-        for (i = cached_lineno_offset; i < offset && str[i] != L'\0'; i++) {
-            // Add one for every newline we find in the range [cached_lineno_offset, offset).
-            if (str[i] == L'\n') {
-                cached_lineno_count++;
-            }
-        }
-        cached_lineno_offset =
-            i;  // note: i, not offset, in case offset is beyond the length of the string
-    } else if (offset < cached_lineno_offset) {
-        // Subtract one for every newline we find in the range [offset, cached_lineno_offset).
-        for (size_t i = offset; i < cached_lineno_offset; i++) {
-            if (str[i] == L'\n') {
-                cached_lineno_count--;
-            }
-        }
-        cached_lineno_offset = offset;
-    }
-    return cached_lineno_count;
+    return static_cast<int>(pstree->line_offset_of_character_at_offset(range->start));
 }
 
-int parse_execution_context_t::get_current_line_number() {
+int parse_execution_context_t::get_current_line_number() const {
     int line_number = -1;
     int line_offset = this->line_offset_of_node(this->executing_job_node);
     if (line_offset >= 0) {
@@ -41,10 +41,6 @@ class parse_execution_context_t {
     // The currently executing job node, used to indicate the line number.
     const ast::job_t *executing_job_node{};
 
-    // Cached line number information.
-    size_t cached_lineno_offset = 0;
-    int cached_lineno_count = 0;
-
     /// If a process dies due to a SIGINT or SIGQUIT, then store the corresponding signal here.
     /// Note this latches to SIGINT or SIGQUIT; it is never cleared.
     int cancel_signal{0};
@@ -127,9 +123,9 @@ class parse_execution_context_t {
     static ast_args_list_t get_argument_nodes(const ast::argument_list_t &args);
     static ast_args_list_t get_argument_nodes(const ast::argument_or_redirection_list_t &args);
 
-    end_execution_reason_t expand_arguments_from_nodes(const ast_args_list_t &argument_nodes,
-                                                       wcstring_list_t *out_arguments,
-                                                       globspec_t glob_behavior);
+    end_execution_reason_t expand_arguments_from_nodes(
+        const ast_args_list_t &argument_nodes, wcstring_list_t *out_arguments,
+        globspec_t glob_behavior, argv_var_span_list_t *out_var_spans = nullptr);
 
     // Determines the list of redirections for a node.
     end_execution_reason_t determine_redirections(const ast::argument_or_redirection_list_t &list,
@@ -147,9 +143,8 @@ class parse_execution_context_t {
     end_execution_reason_t populate_job_from_job_node(job_t *j, const ast::job_t &job_node,
                                                       const block_t *associated_block);
 
-    // Returns the line number of the node. Not const since it touches cached_lineno_offset.
-    int line_offset_of_node(const ast::job_t *node);
-    int line_offset_of_character_at_offset(size_t offset);
+    // Returns the 0-based line number of the node, or -1 if it has no source.
+    int line_offset_of_node(const ast::job_t *node) const;
 
    public:
     /// Construct a context in preparation for evaluating a node in a tree, with the given block_io.
@@ -157,9 +152,8 @@ class parse_execution_context_t {
     parse_execution_context_t(parsed_source_ref_t pstree, const operation_context_t &ctx,
                               io_chain_t block_io);
 
-    /// Returns the current line number, indexed from 1. Not const since it touches
-    /// cached_lineno_offset.
-    int get_current_line_number();
+    /// Returns the current line number, indexed from 1.
+    int get_current_line_number() const;
 
     /// Returns the source offset, or -1.
     int get_current_source_offset() const;
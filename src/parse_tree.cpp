@@ -207,6 +207,17 @@ parsed_source_t::parsed_source_t(wcstring &&s, ast::ast_t &&ast)
 
 parsed_source_t::~parsed_source_t() = default;
 
+size_t parsed_source_t::line_offset_of_character_at_offset(size_t offset) const {
+    assert(offset <= src.size() && "offset out of bounds");
+    std::call_once(newline_offsets_once_, [this] {
+        for (size_t i = src.find(L'\n'); i != wcstring::npos; i = src.find(L'\n', i + 1)) {
+            newline_offsets_.push_back(static_cast<source_offset_t>(i));
+        }
+    });
+    return std::lower_bound(newline_offsets_.begin(), newline_offsets_.end(), offset) -
+           newline_offsets_.begin();
+}
+
 parsed_source_ref_t parse_source(wcstring &&src, parse_tree_flags_t flags,
                                  parse_error_list_t *errors) {
     using namespace ast;
@@ -8,6 +8,7 @@
 
 #include <deque>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "ast.h"
@@ -67,10 +68,19 @@ struct parsed_source_t {
     parsed_source_t(wcstring &&s, ast::ast_t &&ast);
     ~parsed_source_t();
 
+    /// \return the number of newlines in src before \p offset, i.e. the 0-based line of the
+    /// character at \p offset. The first call indexes the newlines, later ones binary search.
+    size_t line_offset_of_character_at_offset(size_t offset) const;
+
     parsed_source_t(const parsed_source_t &) = delete;
     void operator=(const parsed_source_t &) = delete;
     parsed_source_t(parsed_source_t &&) = delete;
     parsed_source_t &operator=(parsed_source_t &&) = delete;
+
+   private:
+    /// The offsets of each newline in src, built on first use.
+    mutable std::vector<source_offset_t> newline_offsets_;
+    mutable std::once_flag newline_offsets_once_;
 };
 
 /// Return a shared pointer to parsed_source_t, or null on failure.
@@ -210,6 +210,9 @@ struct library_data_t {
     /// the command line.
     wcstring_list_t transient_commandlines{};
 
+    /// Pipe contents looked at but not yet consumed by the read builtin.
+    pipe_peek_t read_peek{};
+
     /// A file descriptor holding the current working directory, for use in openat().
     /// This is never null and never invalid.
     std::shared_ptr<const autoclose_fd_t> cwd_fd{};
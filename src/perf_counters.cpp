@@ -0,0 +1,117 @@
+// Counters for the time fish spends in its slower operations.
+#include "config.h"  // IWYU pragma: keep
+
+#include "perf_counters.h"
+
+#include <atomic>
+#include <cstdint>
+
+#include "wutil.h"  // IWYU pragma: keep
+
+namespace {
+/// Durations go into buckets by microseconds: bucket 0 is under 1us, bucket i is under 2^i us,
+/// and the last bucket takes everything longer.
+constexpr size_t kBucketCount = 24;
+
+struct counter_t {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::atomic<uint64_t> buckets[kBucketCount] = {};
+};
+
+/// A copy of a counter, taken all at once for reporting.
+struct counter_snapshot_t {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[kBucketCount];
+};
+
+enum_array_t<counter_t, perf_counter_t> s_counters;
+
+const wchar_t *counter_name(perf_counter_t counter) {
+    switch (counter) {
+        case perf_counter_t::fork:
+            return L"fork";
+        case perf_counter_t::autoload:
+            return L"autoload";
+        case perf_counter_t::highlight:
+            return L"highlight";
+        case perf_counter_t::history_search:
+            return L"history-search";
+        case perf_counter_t::uvar_sync:
+            return L"uvar-sync";
+        case perf_counter_t::complete:
+            return L"complete";
+        case perf_counter_t::COUNT:
+            break;
+    }
+    DIE("Unknown perf counter");
+}
+
+size_t bucket_for(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    size_t bucket = 0;
+    while (us > 0 && bucket + 1 < kBucketCount) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/// \return the upper bound of the bucket holding the \p permille'th duration, or of the maximum
+/// if that is lower.
+uint64_t percentile_ns(const counter_snapshot_t &snap, uint64_t permille) {
+    uint64_t wanted = (snap.count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; i++) {
+        seen += snap.buckets[i];
+        if (seen >= wanted && i + 1 < kBucketCount) {
+            return std::min<uint64_t>((uint64_t(1) << i) * 1000, snap.max_ns);
+        }
+    }
+    return snap.max_ns;
+}
+
+counter_snapshot_t take_snapshot(counter_t &counter, bool reset) {
+    auto take = [=](std::atomic<uint64_t> &value) {
+        return reset ? value.exchange(0, std::memory_order_relaxed)
+                     : value.load(std::memory_order_relaxed);
+    };
+    counter_snapshot_t snap;
+    snap.count = take(counter.count);
+    snap.total_ns = take(counter.total_ns);
+    snap.max_ns = take(counter.max_ns);
+    for (size_t i = 0; i < kBucketCount; i++) snap.buckets[i] = take(counter.buckets[i]);
+    return snap;
+}
+
+double to_ms(uint64_t ns) { return ns / 1e6; }
+}  // namespace
+
+void perf_counter_record(perf_counter_t which, std::chrono::nanoseconds elapsed) {
+    counter_t &counter = s_counters[which];
+    uint64_t ns = elapsed.count() > 0 ? static_cast<uint64_t>(elapsed.count()) : 0;
+    counter.count.fetch_add(1, std::memory_order_relaxed);
+    counter.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    counter.buckets[bucket_for(ns)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = counter.max_ns.load(std::memory_order_relaxed);
+    while (ns > max && !counter.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+wcstring perf_counters_report(bool reset) {
+    wcstring result = format_string(L"%-16ls %10ls %12ls %10ls %10ls %10ls %10ls\n", L"counter",
+                                    L"count", L"total ms", L"mean ms", L"p50 ms", L"p99 ms",
+                                    L"max ms");
+    for (auto which : enum_iter_t<perf_counter_t>{}) {
+        counter_snapshot_t snap = take_snapshot(s_counters[which], reset);
+        double mean = snap.count ? to_ms(snap.total_ns) / snap.count : 0;
+        append_format(result, L"%-16ls %10llu %12.3f %10.3f %10.3f %10.3f %10.3f\n",
+                      counter_name(which), static_cast<unsigned long long>(snap.count),
+                      to_ms(snap.total_ns), mean, to_ms(percentile_ns(snap, 500)),
+                      to_ms(percentile_ns(snap, 990)), to_ms(snap.max_ns));
+    }
+    return result;
+}
@@ -0,0 +1,51 @@
+// Counters for the time fish spends in its slower operations.
+//
+// Each counter records how often an operation ran, how long it took in total and a histogram of
+// the durations in power-of-two microsecond buckets. Recording is a handful of relaxed atomic
+// adds, so the counters are always on, and `status perf` shows them in a running shell.
+#ifndef FISH_PERF_COUNTERS_H
+#define FISH_PERF_COUNTERS_H
+
+#include <chrono>
+
+#include "common.h"
+#include "enum_set.h"
+
+/// The operations which are counted.
+enum class perf_counter_t {
+    fork,            // forking or spawning a process, in the parent
+    autoload,        // loading a function or completion file
+    highlight,       // highlighting a command line
+    history_search,  // searching the history for a match
+    uvar_sync,       // reading and writing the universal variables file
+    complete,        // computing completions
+    COUNT
+};
+
+template <>
+struct enum_info_t<perf_counter_t> {
+    static constexpr auto count = perf_counter_t::COUNT;
+};
+
+/// Record that the operation ran once and took \p elapsed.
+void perf_counter_record(perf_counter_t counter, std::chrono::nanoseconds elapsed);
+
+/// Records the time from its construction to its destruction to a counter.
+class perf_timer_t {
+   public:
+    explicit perf_timer_t(perf_counter_t counter)
+        : counter_(counter), start_(std::chrono::steady_clock::now()) {}
+    perf_timer_t(const perf_timer_t &) = delete;
+    void operator=(const perf_timer_t &) = delete;
+
+    ~perf_timer_t() { perf_counter_record(counter_, std::chrono::steady_clock::now() - start_); }
+
+   private:
+    const perf_counter_t counter_;
+    const std::chrono::steady_clock::time_point start_;
+};
+
+/// \return a table of the counters, one line for each. If \p reset is set, zero them as well.
+wcstring perf_counters_report(bool reset);
+
+#endif
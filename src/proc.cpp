@@ -993,6 +993,9 @@ void job_t::continue_job(parser_t &parser, bool in_foreground) {
 
         // If both requested and necessary, send the job a continue signal.
         if (send_sigcont) {
+            // Once it runs again, the job may read from a pipe that `read` has looked at.
+            parser.libdata().read_peek.invalidate();
+
             // This code used to check for JOB_CONTROL to decide between using killpg to signal all
             // processes in the group or iterating over each process in the group and sending the
             // signal individually. job_t::signal() does the same, but uses the shell's own pgroup
@@ -48,6 +48,7 @@ struct statement_t;
 
 class job_group_t;
 using job_group_ref_t = std::shared_ptr<job_group_t>;
+struct builtin_data_t;
 
 /// A proc_status_t is a value type that encapsulates logic around exited vs stopped vs signaled,
 /// etc.
@@ -197,7 +198,10 @@ enum { INVALID_PID = -2 };
 class parser_t;
 class process_t {
    private:
-    null_terminated_array_t<wchar_t> argv_array;
+    // The arguments, and a null-terminated array pointing into them which is what gets handed to
+    // builtins, so they don't need to be copied into one.
+    wcstring_list_t argv_list_;
+    std::vector<wchar_t *> argv_ptrs_;
 
     redirection_spec_list_t proc_redirection_specs;
 
@@ -227,24 +231,40 @@ class process_t {
     /// The expanded variable assignments for this process, as specified by the `a=b cmd` syntax.
     std::vector<concrete_assignment> variable_assignments;
 
+    /// For builtins, the builtin named by argv[0] if it has been looked up already.
+    const builtin_data_t *builtin{nullptr};
+
+    /// For builtins, the runs of arguments which came from expanding a bare variable.
+    argv_var_span_list_t argv_var_spans;
+
     /// Sets argv.
-    void set_argv(const wcstring_list_t &argv) { argv_array.set(argv); }
+    void set_argv(wcstring_list_t argv) {
+        argv_list_ = std::move(argv);
+        argv_ptrs_.clear();
+        argv_ptrs_.reserve(argv_list_.size() + 1);
+        for (wcstring &arg : argv_list_) {
+            argv_ptrs_.push_back(&arg[0]);
+        }
+        argv_ptrs_.push_back(nullptr);
+    }
 
     /// Returns argv.
-    wchar_t **get_argv() { return argv_array.get(); }
-    const wchar_t *const *get_argv() const { return argv_array.get(); }
-    const null_terminated_array_t<wchar_t> &get_argv_array() const { return argv_array; }
+    wchar_t **get_argv() { return argv_ptrs_.empty() ? nullptr : argv_ptrs_.data(); }
+    const wchar_t *const *get_argv() const {
+        return argv_ptrs_.empty() ? nullptr : argv_ptrs_.data();
+    }
+    const wcstring_list_t &get_argv_list() const { return argv_list_; }
 
     /// Returns argv[idx].
     const wchar_t *argv(size_t idx) const {
-        const wchar_t *const *argv = argv_array.get();
+        const wchar_t *const *argv = get_argv();
         assert(argv != nullptr);
         return argv[idx];
     }
 
     /// Returns argv[0], or NULL.
     const wchar_t *argv0() const {
-        const wchar_t *const *argv = argv_array.get();
+        const wchar_t *const *argv = get_argv();
         return argv ? argv[0] : nullptr;
     }
 
@@ -1828,6 +1828,7 @@ static bool check_for_orphaned_process(unsigned long loop_count, pid_t shell_pgi
 #endif
         if (!tty) {
             wperror(L"ctermid");
+            flog_flush();
             exit_without_destructors(1);
         }
 
@@ -1835,6 +1836,7 @@ static bool check_for_orphaned_process(unsigned long loop_count, pid_t shell_pgi
         autoclose_fd_t tty_fd{open(tty, O_RDONLY | O_NONBLOCK)};
         if (!tty_fd.valid()) {
             wperror(L"open");
+            flog_flush();
             exit_without_destructors(1);
         }
 
@@ -1905,6 +1907,7 @@ static void acquire_tty_or_exit(pid_t shell_pgid) {
             redirect_tty_output();
             FLOGF(warning, _(L"No TTY for interactive shell (tcgetpgrp failed)"));
             wperror(L"setpgid");
+            flog_flush();
             exit_without_destructors(1);
         }
         if (owner == shell_pgid) {
@@ -1916,6 +1919,7 @@ static void acquire_tty_or_exit(pid_t shell_pgid) {
                     _(L"I appear to be an orphaned process, so I am quitting politely. "
                       L"My pid is %d.");
                 FLOGF(warning, fmt, static_cast<int>(getpid()));
+                flog_flush();
                 exit_without_destructors(1);
             }
 
@@ -1923,6 +1927,7 @@ static void acquire_tty_or_exit(pid_t shell_pgid) {
             int ret = killpg(shell_pgid, SIGTTIN);
             if (ret < 0) {
                 wperror(L"killpg(shell_pgid, SIGTTIN)");
+                flog_flush();
                 exit_without_destructors(1);
             }
         }
@@ -1958,6 +1963,7 @@ static void reader_interactive_init(parser_t &parser) {
             if (errno != EPERM) {
                 FLOG(error, _(L"Failed to assign shell to its own process group"));
                 wperror(L"setpgid");
+                flog_flush();
                 exit_without_destructors(1);
             }
         }
@@ -1969,6 +1975,7 @@ static void reader_interactive_init(parser_t &parser) {
             }
             FLOG(error, _(L"Failed to take control of the terminal"));
             wperror(L"tcsetpgrp");
+            flog_flush();
             exit_without_destructors(1);
         }
 
@@ -3916,3 +3923,13 @@ int reader_read(parser_t &parser, int fd, const io_chain_t &io) {
 
     return res;
 }
+
+int reader_read_parsed(parser_t &parser, const parsed_source_ref_t &ps, const io_chain_t &io) {
+    scoped_push<bool> interactive_push{&parser.libdata().is_interactive, false};
+    signal_set_handlers_once(false);
+    parser.eval(ps, io);
+
+    // If the exit command was called in a script, only exit the script, not the program.
+    parser.libdata().exit_current_script = false;
+    return 0;
+}
@@ -13,6 +13,7 @@
 #include "complete.h"
 #include "highlight.h"
 #include "parse_constants.h"
+#include "parse_tree.h"
 
 class environment_t;
 class history_t;
@@ -118,6 +119,9 @@ class editable_line_t {
 /// The fd is not closed.
 int reader_read(parser_t &parser, int fd, const io_chain_t &io);
 
+/// Like reader_read() on a script file, but for a script that has already been read and parsed.
+int reader_read_parsed(parser_t &parser, const parsed_source_ref_t &ps, const io_chain_t &io);
+
 /// Mark that we encountered SIGHUP and must (soon) exit. This is invoked from a signal handler.
 void reader_sighup();
 
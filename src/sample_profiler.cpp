@@ -0,0 +1,211 @@
+// A sampling profiler for fish script.
+#include "config.h"  // IWYU pragma: keep
+
+#include "sample_profiler.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "fallback.h"  // IWYU pragma: keep
+#include "flog.h"
+#include "parser.h"
+#include "signal.h"
+#include "wcstringutil.h"
+#include "wutil.h"  // IWYU pragma: keep
+
+/// How often to sample, in microseconds of CPU time.
+static constexpr long kSampleIntervalUsec = 1000;
+
+/// Number of times the timer has fired, and how many of those have been collected as samples.
+/// The counter is lock-free, so the signal handler may touch it.
+static std::atomic<uint32_t> s_ticks{0};
+static uint32_t s_collected_ticks = 0;
+
+/// The number of samples of each stack, keyed by the folded stack. Main thread only.
+static std::unordered_map<wcstring, uint64_t> s_samples;
+
+/// Whether the profiler is running, and where its output goes. Main thread only.
+static bool s_running = false;
+static std::string s_folded_path;
+static std::string s_report_path;
+
+static void set_timer(long interval_usec) {
+    struct itimerval timer = {};
+    timer.it_interval.tv_sec = interval_usec / 1000000;
+    timer.it_interval.tv_usec = interval_usec % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        wperror(L"setitimer");
+    }
+}
+
+void sample_profiler_start(std::string folded_path, std::string report_path) {
+    ASSERT_IS_MAIN_THREAD();
+    s_folded_path = std::move(folded_path);
+    s_report_path = std::move(report_path);
+    s_running = true;
+    signal_set_profiler_handler();
+    set_timer(kSampleIntervalUsec);
+}
+
+void sample_profiler_tick() { s_ticks.fetch_add(1, std::memory_order_relaxed); }
+
+/// Append \p frame to the folded \p stack. The format reserves semicolons and newlines.
+static void append_frame(wcstring *stack, const wcstring &frame) {
+    if (!stack->empty()) stack->push_back(L';');
+    for (wchar_t c : frame) {
+        stack->push_back(c == L';' || c == L'\n' ? L' ' : c);
+    }
+}
+
+static wcstring line_frame(const wchar_t *filename, int lineno) {
+    return format_string(L"%ls:%d", filename ? filename : L"-", lineno);
+}
+
+void sample_profiler_poll(const parser_t &parser) {
+    uint32_t ticks = s_ticks.load(std::memory_order_relaxed);
+    if (ticks == s_collected_ticks) return;
+    uint32_t due = ticks - s_collected_ticks;
+    s_collected_ticks = ticks;
+
+    // The stack alternates between the line that made a call and what it called, from the
+    // outermost block in, and ends with the line being executed.
+    wcstring stack;
+    const auto &blocks = parser.blocks();
+    for (auto iter = blocks.rbegin(); iter != blocks.rend(); ++iter) {
+        const block_t &block = *iter;
+        if (block.is_function_call()) {
+            append_frame(&stack, line_frame(block.src_filename, block.src_lineno));
+            append_frame(&stack, block.function_name);
+        } else if (block.type() == block_type_t::source) {
+            append_frame(&stack, line_frame(block.src_filename, block.src_lineno));
+            append_frame(&stack, format_string(L"source %ls", block.sourced_file));
+        } else if (block.type() == block_type_t::subst) {
+            // Lines in a command substitution count from its start.
+            append_frame(&stack, line_frame(block.src_filename, block.src_lineno));
+            append_frame(&stack, L"command substitution");
+        }
+    }
+    append_frame(&stack, line_frame(parser.current_filename(), parser.get_lineno()));
+    s_samples[stack] += due;
+}
+
+/// Write the samples as folded stacks, one "frame;frame;frame count" line per distinct stack,
+/// which is what flame graph tools take.
+static void write_folded(FILE *out) {
+    std::vector<std::pair<wcstring, uint64_t>> stacks(s_samples.begin(), s_samples.end());
+    std::sort(stacks.begin(), stacks.end());
+    for (const auto &stack : stacks) {
+        std::string line = wcs2string(stack.first);
+        line.push_back(' ');
+        line.append(std::to_string(stack.second));
+        line.push_back('\n');
+        if (fwrite(line.data(), line.size(), 1, out) != 1) {
+            wperror(L"fwrite");
+            return;
+        }
+    }
+}
+
+namespace {
+/// A frame in the report, with the samples taken in it and in the frames it called.
+struct report_frame_t {
+    uint64_t self{0};
+    uint64_t total{0};
+    std::map<wcstring, std::unique_ptr<report_frame_t>> callees;
+};
+using named_frame_t = std::pair<const wcstring *, const report_frame_t *>;
+}  // namespace
+
+/// \return the frames \p frame called, biggest first.
+static std::vector<named_frame_t> callees_by_total(const report_frame_t &frame) {
+    std::vector<named_frame_t> result;
+    for (const auto &callee : frame.callees) {
+        result.emplace_back(&callee.first, callee.second.get());
+    }
+    std::stable_sort(result.begin(), result.end(),
+                     [](const named_frame_t &a, const named_frame_t &b) {
+                         return a.second->total > b.second->total;
+                     });
+    return result;
+}
+
+static bool print_report_frame(const named_frame_t &frame, size_t level, FILE *out) {
+    std::string line = std::to_string(frame.second->self * kSampleIntervalUsec);
+    line.push_back('\t');
+    line.append(std::to_string(frame.second->total * kSampleIntervalUsec));
+    line.push_back('\t');
+    line.append(level, '-');
+    line.append("> ");
+    line.append(wcs2string(*frame.first));
+    line.push_back('\n');
+    if (fwrite(line.data(), line.size(), 1, out) != 1) {
+        wperror(L"fwrite");
+        return false;
+    }
+    for (const named_frame_t &callee : callees_by_total(*frame.second)) {
+        if (!print_report_frame(callee, level + 1, out)) return false;
+    }
+    return true;
+}
+
+/// Write the samples as a tree of frames, with the self and total time of each in microseconds.
+static void write_report(FILE *out) {
+    report_frame_t root;
+    for (const auto &stack : s_samples) {
+        report_frame_t *frame = &root;
+        for (const wcstring &name : split_string(stack.first, L';')) {
+            std::unique_ptr<report_frame_t> &callee = frame->callees[name];
+            if (!callee) callee = make_unique<report_frame_t>();
+            frame = callee.get();
+            frame->total += stack.second;
+        }
+        frame->self += stack.second;
+    }
+
+    std::string header = wcs2string(_(L"Time\tSum\tFrame\n"));
+    if (fwrite(header.data(), header.size(), 1, out) != 1) {
+        wperror(L"fwrite");
+        return;
+    }
+    for (const named_frame_t &frame : callees_by_total(root)) {
+        if (!print_report_frame(frame, 0, out)) return;
+    }
+}
+
+/// Write the samples to \p path with \p write, if a path was given.
+static void write_samples(const std::string &path, void (*write)(FILE *)) {
+    if (path.empty()) return;
+    // OK to not use CLO_EXEC here because this is called while fish is exiting or exec'ing.
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        FLOGF(warning, _(L"Could not write profiling information to file '%s'"), path.c_str());
+        return;
+    }
+    write(f);
+    if (fclose(f)) {
+        wperror(L"fclose");
+    }
+}
+
+void sample_profiler_finish() {
+    ASSERT_IS_MAIN_THREAD();
+    if (!s_running) return;
+    s_running = false;
+    // Stop the timer before resetting the handler, so a last tick cannot kill fish.
+    set_timer(0);
+    signal_reset_profiler_handler();
+    write_samples(s_folded_path, write_folded);
+    write_samples(s_report_path, write_report);
+}
@@ -0,0 +1,29 @@
+// A sampling profiler for fish script.
+//
+// A CPU timer signal marks samples as due, and the main thread collects them the next time the
+// parser starts or finishes a job, attributing each to the function stack and line it is executing.
+// The signal handler only bumps a counter, so sampling costs next to nothing between samples.
+#ifndef FISH_SAMPLE_PROFILER_H
+#define FISH_SAMPLE_PROFILER_H
+
+#include <string>
+
+class parser_t;
+
+/// Start sampling the CPU time fish uses. The samples are written when the profiler is finished,
+/// as folded stacks to \p folded_path and as a report to \p report_path, unless those are empty.
+void sample_profiler_start(std::string folded_path, std::string report_path);
+
+/// Stop sampling, restore the default SIGPROF action and write the samples. Call this before
+/// exiting or exec'ing, as the timer would otherwise outlive fish and kill the new program. Does
+/// nothing if the profiler is not running.
+void sample_profiler_finish();
+
+/// Called from the signal handler when the sampling timer fires.
+void sample_profiler_tick();
+
+/// Collect any samples which are due, attributing them to the parser's current position. This is
+/// cheap if there are none. Must be called on the main thread.
+void sample_profiler_poll(const parser_t &parser);
+
+#endif
@@ -15,6 +15,7 @@
 #include "parser.h"
 #include "proc.h"
 #include "reader.h"
+#include "sample_profiler.h"
 #include "signal.h"
 #include "termsize.h"
 #include "topic_monitor.h"
@@ -262,6 +263,13 @@ static void fish_signal_handler(int sig, siginfo_t *info, void *context) {
             topic_monitor_t::principal().post(topic_t::sigchld);
             break;
 
+#ifdef SIGPROF
+        case SIGPROF:
+            // The sampling profiler's timer fired.
+            sample_profiler_tick();
+            break;
+#endif
+
         case SIGALRM:
             // We have a sigalarm handler that does nothing. This is used in the signal torture
             // test, to verify that we behave correctly when receiving lots of irrelevant signals.
@@ -397,6 +405,28 @@ void get_signals_with_handlers(sigset_t *set) {
     }
 }
 
+void signal_set_profiler_handler() {
+#ifdef SIGPROF
+    struct sigaction act;
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = SA_SIGINFO | SA_RESTART;
+    act.sa_sigaction = &fish_signal_handler;
+    if (sigaction(SIGPROF, &act, nullptr)) {
+        wperror(L"sigaction");
+    }
+#endif
+}
+
+void signal_reset_profiler_handler() {
+#ifdef SIGPROF
+    struct sigaction act;
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = 0;
+    act.sa_handler = SIG_DFL;
+    sigaction(SIGPROF, &act, nullptr);
+#endif
+}
+
 /// Ensure we did not inherit any blocked signals. See issue #3964.
 void signal_unblock_all() {
     sigset_t iset;
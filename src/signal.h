@@ -27,6 +27,13 @@ void signal_set_handlers_once(bool interactive);
 /// \param sig The signal to specify the action of
 void signal_handle(int sig);
 
+/// Handle SIGPROF by ticking the sampling profiler. Unlike other signals, it restarts system calls,
+/// as it fires all the time.
+void signal_set_profiler_handler();
+
+/// Restore the default action for SIGPROF, once the sampling profiler has stopped.
+void signal_reset_profiler_handler();
+
 /// Ensure we did not inherit any blocked signals. See issue #3964.
 void signal_unblock_all();
 
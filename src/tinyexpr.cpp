@@ -23,6 +23,8 @@
  */
 
 // This version has been altered and ported to C++ for inclusion in fish.
+#include "config.h"  // IWYU pragma: keep
+
 #include "tinyexpr.h"
 
 #include <ctype.h>
@@ -34,7 +36,12 @@
 #include <algorithm>
 #include <cstring>
 #include <iterator>
+#include <string>
 #include <utility>
+#include <vector>
+
+#include "fallback.h"  // IWYU pragma: keep
+#include "wutil.h"
 
 // TODO: It would be nice not to rely on a typedef for this, especially one that can only do
 // functions with two args.
@@ -48,6 +55,7 @@ enum {
     TE_FUNCTION1,
     TE_FUNCTION2,
     TE_FUNCTION3,
+    TE_LITERAL,
     TOK_NULL,
     TOK_ERROR,
     TOK_END,
@@ -55,6 +63,7 @@ enum {
     TOK_OPEN,
     TOK_CLOSE,
     TOK_NUMBER,
+    TOK_PLACEHOLDER,
     TOK_INFIX
 };
 
@@ -70,6 +79,8 @@ typedef struct te_expr {
     union {
         double value;
         const void *function;
+        // For TE_LITERAL, the index of the literal's value in the array passed to te_eval.
+        size_t literal;
     };
     te_expr *parameters[];
 } te_expr;
@@ -89,19 +100,10 @@ using state = struct {
     const char *next;
     int type;
     te_error_type_t error;
+    // The number of literals the parser has seen so far.
+    size_t literal_count;
 };
 
-/* Parses the input expression. */
-/* Returns NULL on error. */
-te_expr *te_compile(const char *expression, te_error_t *error);
-
-/* Evaluates the expression. */
-double te_eval(const te_expr *n);
-
-/* Frees the expression. */
-/* This is safe to call on NULL pointers. */
-void te_free(te_expr *n);
-
 // TODO: That move there? Ouch. Replace with a proper class with a constructor.
 #define NEW_EXPR(type, ...) new_expr((type), std::move((const te_expr *[]){__VA_ARGS__}))
 
@@ -220,6 +222,35 @@ static constexpr double divide(double a, double b) {
 
 static constexpr double negate(double a) { return -a; }
 
+/// Parse a number the way strtod() does in the C locale, so "." is the radix character no matter
+/// what LC_NUMERIC says.
+static double parse_number(const char *str, const char **end) {
+    // Fast path for plain integers, which is what most expressions are made of. Up to 15 digits
+    // are exactly representable, so this gives the same result as strtod().
+    double value = 0;
+    const char *cursor = str;
+    while (*cursor >= '0' && *cursor <= '9' && cursor - str < 15) {
+        value = value * 10 + (*cursor - '0');
+        cursor++;
+    }
+    if (cursor > str && (!*cursor || !std::strchr("0123456789.eExX", *cursor))) {
+        *end = cursor;
+        return value;
+    }
+
+    // Widen everything that could possibly be part of the number and hand it to wcstod_l().
+    wcstring wide;
+    for (cursor = str; isalnum(static_cast<unsigned char>(*cursor)) || *cursor == '.' ||
+                       ((*cursor == '+' || *cursor == '-') && std::strchr("eEpP", cursor[-1]));
+         cursor++) {
+        wide.push_back(*cursor);
+    }
+    wchar_t *wide_end = nullptr;
+    value = wcstod_l(wide.c_str(), &wide_end, fish_c_locale());
+    *end = str + (wide_end - wide.c_str());
+    return value;
+}
+
 void next_token(state *s) {
     s->type = TOK_NULL;
 
@@ -231,8 +262,14 @@ void next_token(state *s) {
 
         /* Try reading a number. */
         if ((s->next[0] >= '0' && s->next[0] <= '9') || s->next[0] == '.') {
-            s->value = strtod(s->next, const_cast<char **>(&s->next));
+            const char *start = s->next;
+            s->value = parse_number(start, &s->next);
             s->type = TOK_NUMBER;
+            if (s->next == start) {
+                // Not a number after all, e.g. a lone ".".
+                s->type = TOK_ERROR;
+                s->error = TE_ERROR_UNEXPECTED_TOKEN;
+            }
         } else {
             /* Look for a function call. */
             // But not when it's an "x" followed by whitespace
@@ -301,6 +338,16 @@ void next_token(state *s) {
                     case ',':
                         s->type = TOK_SEP;
                         break;
+                    case '{':
+                        // "{}" stands for a value that is only known at evaluation time.
+                        if (s->next[0] == '}') {
+                            s->next++;
+                            s->type = TOK_PLACEHOLDER;
+                        } else {
+                            s->type = TOK_ERROR;
+                            s->error = TE_ERROR_MISSING_OPERATOR;
+                        }
+                        break;
                     case ' ':
                     case '\t':
                     case '\n':
@@ -336,8 +383,11 @@ static te_expr *base(state *s) {
 
     switch (s->type) {
         case TOK_NUMBER:
-            ret = new_expr(TE_CONSTANT, nullptr);
-            ret->value = s->value;
+        case TOK_PLACEHOLDER:
+            // Literals are not baked into the tree so it can be reused for other expressions of
+            // the same shape; their values are passed to te_eval.
+            ret = new_expr(TE_LITERAL, nullptr);
+            ret->literal = s->literal_count++;
             next_token(s);
             break;
 
@@ -499,14 +549,16 @@ static te_expr *expr(state *s) {
 }
 
 #define TE_FUN(...) ((double (*)(__VA_ARGS__))n->function)
-#define M(e) te_eval(n->parameters[e])
+#define M(e) te_eval(n->parameters[e], literals)
 
-double te_eval(const te_expr *n) {
+double te_eval(const te_expr *n, const double *literals) {
     if (!n) return NAN;
 
     switch (n->type) {
         case TE_CONSTANT:
             return n->value;
+        case TE_LITERAL:
+            return literals[n->literal];
         case TE_FUNCTION0:
             return TE_FUN(void)();
         case TE_FUNCTION1:
@@ -525,7 +577,7 @@ double te_eval(const te_expr *n) {
 
 static void optimize(te_expr *n) {
     /* Evaluates as much as possible. */
-    if (n->type == TE_CONSTANT) return;
+    if (n->type == TE_CONSTANT || n->type == TE_LITERAL) return;
 
     const int arity = get_arity(n->type);
     bool known = true;
@@ -536,7 +588,7 @@ static void optimize(te_expr *n) {
         }
     }
     if (known) {
-        const double value = te_eval(n);
+        const double value = te_eval(n, nullptr);
         te_free_parameters(n);
         n->type = TE_CONSTANT;
         n->value = value;
@@ -547,6 +599,7 @@ te_expr *te_compile(const char *expression, te_error_t *error) {
     state s;
     s.start = s.next = expression;
     s.error = TE_ERROR_NONE;
+    s.literal_count = 0;
 
     next_token(&s);
     te_expr *root = expr(&s);
@@ -574,14 +627,47 @@ te_expr *te_compile(const char *expression, te_error_t *error) {
     }
 }
 
+bool te_shape(const char *expression, std::string *shape, te_literals_t *literals) {
+    state s;
+    s.start = s.next = expression;
+    s.error = TE_ERROR_NONE;
+
+    literals->values.clear();
+    literals->placeholders.clear();
+    if (shape) shape->clear();
+    for (;;) {
+        const char *token_start = s.next;
+        next_token(&s);
+        if (s.type == TOK_END) return true;
+        if (s.type == TOK_ERROR) return false;
+
+        // Separate tokens by a space so different token sequences can't produce the same shape.
+        // The whitespace in front of the token is skipped by next_token, strip it here too.
+        if (shape) {
+            if (!shape->empty()) shape->push_back(' ');
+            if (s.type == TOK_NUMBER) {
+                shape->push_back('#');
+            } else {
+                while (isspace(static_cast<unsigned char>(*token_start))) token_start++;
+                shape->append(token_start, s.next);
+            }
+        }
+        if (s.type == TOK_NUMBER) {
+            literals->values.push_back(s.value);
+        } else if (s.type == TOK_PLACEHOLDER) {
+            literals->placeholders.push_back(literals->values.size());
+            literals->values.push_back(NAN);
+        }
+    }
+}
+
 double te_interp(const char *expression, te_error_t *error) {
     te_expr *n = te_compile(expression, error);
-    double ret;
-    if (n) {
-        ret = te_eval(n);
-        te_free(n);
-    } else {
-        ret = NAN;
+    double ret = NAN;
+    te_literals_t literals;
+    if (n && te_shape(expression, nullptr, &literals)) {
+        ret = te_eval(n, literals.values.data());
     }
+    te_free(n);
     return ret;
 }
@@ -27,6 +27,10 @@
 #ifndef __TINYEXPR_H__
 #define __TINYEXPR_H__
 
+#include <cstddef>
+#include <string>
+#include <vector>
+
 typedef enum {
     TE_ERROR_NONE = 0,
     TE_ERROR_UNKNOWN_FUNCTION = 1,
@@ -45,6 +49,32 @@ typedef struct te_error_t {
     int position;
 } te_error_t;
 
+typedef struct te_expr te_expr;
+
+/// The values of the number literals in an expression, in the order they appear.
+struct te_literals_t {
+    std::vector<double> values;
+    /// Indexes into values of the "{}" placeholders, which the caller fills in before evaluating.
+    std::vector<size_t> placeholders;
+};
+
+/// Parse an expression. Returns NULL on error.
+/// Number literals are not part of the compiled tree, but are passed to te_eval, so the tree can
+/// be reused for any expression of the same shape.
+te_expr *te_compile(const char *expression, te_error_t *error);
+
+/// Evaluate a compiled expression, with the literals from te_shape.
+double te_eval(const te_expr *n, const double *literals);
+
+/// Free a compiled expression. This is safe to call on NULL pointers.
+void te_free(te_expr *n);
+
+/// Tokenize an expression without compiling it, putting the values of its literals in \p literals.
+/// If \p shape is not null, it is set to a description of the expression that is identical for
+/// all expressions that only differ in their literals. Returns false if the expression can't be
+/// tokenized, in which case te_compile will report the error.
+bool te_shape(const char *expression, std::string *shape, te_literals_t *literals);
+
 /* Parses the input expression, evaluates it, and frees it. */
 /* Returns NaN on error. */
 double te_interp(const char *expression, te_error_t *error);
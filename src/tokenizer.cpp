@@ -6,6 +6,7 @@
 
 #include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <wctype.h>
 
@@ -123,10 +124,47 @@ static bool tok_is_string_character(wchar_t c, bool is_first) {
     }
 }
 
-/// Quick test to catch the most common 'non-magical' characters, makes read_string slightly faster
-/// by adding a fast path for the most common characters. This is obviously not a suitable
-/// replacement for iswalpha.
-static inline int myal(wchar_t c) { return (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z'); }
+/// Test if a character may have a special meaning in read_string: the terminating nul, separators,
+/// quotes, the escape character and brackets. Other characters never change the mode.
+static inline bool is_token_special(wchar_t c) {
+    // Bit n of the first mask is set if character n is special, and likewise for the second mask
+    // and character 64 + n.
+    constexpr uint64_t low = (1ULL << 0x00) | (1ULL << L'\t') | (1ULL << L'\n') | (1ULL << L'\r') |
+                             (1ULL << L' ') | (1ULL << L'"') | (1ULL << L'&') | (1ULL << L'\'') |
+                             (1ULL << L'(') | (1ULL << L')') | (1ULL << L';') | (1ULL << L'<') |
+                             (1ULL << L'>');
+    constexpr uint64_t high = (1ULL << (L'[' - 64)) | (1ULL << (L'\\' - 64)) |
+                              (1ULL << (L']' - 64)) | (1ULL << (L'^' - 64)) |
+                              (1ULL << (L'{' - 64)) | (1ULL << (L'|' - 64)) | (1ULL << (L'}' - 64));
+    auto u = static_cast<uint32_t>(c);
+    if (u < 64) return (low >> u) & 1;
+    if (u < 128) return (high >> (u - 64)) & 1;
+    return false;
+}
+
+/// \return the first character at or after \p cursor which is special, per is_token_special().
+static const wchar_t *skip_ordinary_chars(const wchar_t *cursor) {
+    while (!is_token_special(*cursor)) cursor++;
+    return cursor;
+}
+
+/// Like quote_end(): \return the closing quote for the quote at \p pos, or null if there is none.
+static const wchar_t *find_quote_end(const wchar_t *pos) {
+    const wchar_t quote = *pos;
+    for (pos++;; pos++) {
+        while (*pos != quote && *pos != L'\\' && *pos != L'\0') pos++;
+        if (*pos == quote) return pos;
+        if (*pos == L'\0') return nullptr;
+        // A backslash escapes the next character, whatever it is.
+        if (*++pos == L'\0') return nullptr;
+    }
+}
+
+/// \return the end of the line starting at or after \p cursor: the newline, or the terminating nul.
+static const wchar_t *find_line_end(const wchar_t *cursor) {
+    while (*cursor != L'\n' && *cursor != L'\0') cursor++;
+    return cursor;
+}
 
 namespace tok_modes {
 enum {
@@ -150,6 +188,16 @@ tok_t tokenizer_t::read_string() {
     bool is_first = true;
 
     while (true) {
+        // Ordinary characters never change the mode, so skip over them in bulk. An escaped
+        // character still has to go through the checks below, to leave escape mode.
+        if (!(mode & tok_modes::char_escape)) {
+            const wchar_t *next = skip_ordinary_chars(this->token_cursor);
+            if (next != this->token_cursor) {
+                this->token_cursor = next;
+                is_first = false;
+            }
+        }
+
         wchar_t c = *this->token_cursor;
 #if false
         wcstring msg = L"Handling 0x%x (%lc)";
@@ -164,9 +212,6 @@ tok_t tokenizer_t::read_string() {
         if ((mode & tok_modes::char_escape) == tok_modes::char_escape) {
             mode &= ~(tok_modes::char_escape);
             // and do nothing more
-        } else if (myal(c)) {
-            // Early exit optimization in case the character is just a letter,
-            // which has no special meaning to the tokenizer, i.e. the same mode continues.
         }
 
         // Now proceed with the evaluation of the token, first checking to see if the token
@@ -225,7 +270,7 @@ tok_t tokenizer_t::read_string() {
         else if (c == L']' && ((mode & tok_modes::array_brackets) == tok_modes::array_brackets)) {
             mode &= ~(tok_modes::array_brackets);
         } else if (c == L'\'' || c == L'"') {
-            const wchar_t *end = quote_end(this->token_cursor);
+            const wchar_t *end = find_quote_end(this->token_cursor);
             if (end) {
                 this->token_cursor = end;
             } else {
@@ -512,8 +557,7 @@ maybe_t<tok_t> tokenizer_t::next() {
     while (*this->token_cursor == L'#') {
         // We have a comment, walk over the comment.
         const wchar_t *comment_start = this->token_cursor;
-        while (this->token_cursor[0] != L'\n' && this->token_cursor[0] != L'\0')
-            this->token_cursor++;
+        this->token_cursor = find_line_end(this->token_cursor);
         size_t comment_len = this->token_cursor - comment_start;
 
         // If we are going to continue after the comment, skip any trailing newline.
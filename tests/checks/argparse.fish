@@ -440,3 +440,20 @@ function wrongargparse
     argparse a-b
     argparse
 end
+
+# The same specs parse each call's arguments afresh.
+function argparse_repeat
+    argparse -x a,b a/all b/brief 'c/count=' 'e/exclude=+' -- $argv
+    or return
+    echo (set -q _flag_a; and echo all) (set -q _flag_b; and echo brief) "count=$_flag_c" "exclude=$_flag_e" "argv=$argv"
+end
+argparse_repeat -a -c 3 -e x -e y one
+argparse_repeat -b two
+argparse_repeat -e z
+argparse_repeat -a -b
+argparse_repeat -a --exclude w three
+#CHECK: all count=3 exclude=x y argv=one
+#CHECK: brief count= exclude= argv=two
+#CHECK: count= exclude=z argv=
+#CHECKERR: argparse_repeat: Mutually exclusive flags 'a/all' and `b/brief` seen
+#CHECK: all count= exclude=w argv=three
@@ -210,6 +210,23 @@ contains -i -- -- a b c; or echo nothing
 contains -i -- -- a b c -- v
 #CHECK: 4
 
+# Long lists from a variable are searched through an index, which must track changes.
+set -l long (seq 50) 7 ""
+contains -i 7 $long
+#CHECK: 7
+contains -i 7 x $long
+#CHECK: 8
+contains -i "" $long
+#CHECK: 52
+set long[7] seven
+contains -i 7 $long
+#CHECK: 51
+set -e long[51]
+contains 7 $long; or echo nothing
+#CHECK: nothing
+contains -i 7 $long 7 $long
+#CHECK: 52
+
 # Test if, else, and else if
 if true
 	echo alpha1.1
@@ -350,6 +367,28 @@ end
 emit test3 foo bar
 #CHECK: received event test3 with args: foo bar
 
+# Arguments reach the handler as they were, without being re-parsed.
+emit test3 'a b' '$var' '(echo no)'
+#CHECK: received event test3 with args: a b $var (echo no)
+emit test3 'a b' '' \*
+#CHECK: received event test3 with args: a b  *
+
+# Handlers for a variable run in the order they were defined, and not for other variables.
+function watch_ev1 --on-variable __fish_ev_watched
+    echo first $argv
+end
+function watch_ev2 --on-variable __fish_ev_watched
+    echo second $argv
+end
+set -g __fish_ev_watched 1
+set -g __fish_ev_other 1
+#CHECK: first VARIABLE SET __fish_ev_watched
+#CHECK: second VARIABLE SET __fish_ev_watched
+functions -e watch_ev1
+set -e __fish_ev_watched
+#CHECK: second VARIABLE ERASE __fish_ev_watched
+functions -e watch_ev2
+
 # test empty argument
 emit
 #CHECKERR: emit: expected event name
@@ -189,6 +189,27 @@ expansion (echo one)[2..-1]
 #CHECK: 0
 #CHECK: 0
 
+# Command substitution output is never expanded again, whether or not it is the whole word.
+set -l items '*' '$HOME' '~' '{a,b}' '%self' 'a b' '' "it's" '"q"' '(echo no)'
+printf '<%s>\n' (printf '%s\n' $items)
+#CHECK: <*>
+#CHECK: <$HOME>
+#CHECK: <~>
+#CHECK: <{a,b}>
+#CHECK: <%self>
+#CHECK: <a b>
+#CHECK: <>
+#CHECK: <it's>
+#CHECK: <"q">
+#CHECK: <(echo no)>
+printf '<%s>\n' (printf '%s\n' $items)[1 -1]
+#CHECK: <*>
+#CHECK: <(echo no)>
+printf '<%s>\n' x(printf '%s\n' $items[1..3])y
+#CHECK: <x*y>
+#CHECK: <x$HOMEy>
+#CHECK: <x~y>
+
 set -l foo
 expansion "$foo[1]"
 expansion $foo[1]
@@ -389,3 +389,30 @@ echo 'if true; and false; or true
 end' | $fish_indent --check
 echo $status
 #CHECK: 0
+
+# Several files may be formatted at once, with the results in the order the files were given.
+set -l tmpdir (mktemp -d)
+for i in 1 2 3 4 5 6
+    echo "echo   $i" >$tmpdir/$i.fish
+end
+echo 'echo 7' >$tmpdir/7.fish
+$fish_indent --jobs 3 $tmpdir/{1,2,3,4,5,6,7}.fish
+#CHECK: echo 1
+#CHECK: echo 2
+#CHECK: echo 3
+#CHECK: echo 4
+#CHECK: echo 5
+#CHECK: echo 6
+#CHECK: echo 7
+$fish_indent -j 4 --check $tmpdir/{7,2,1}.fish 2>&1 | string replace $tmpdir/ ''
+echo $pipestatus[1]
+#CHECK: 2.fish
+#CHECK: 1.fish
+#CHECK: 2
+$fish_indent -j 4 -w $tmpdir/{1,2,3,4,5,6,7}.fish
+$fish_indent -j 4 --check $tmpdir/{1,2,3,4,5,6,7}.fish
+echo $status
+#CHECK: 0
+$fish_indent -j 0 $tmpdir/1.fish
+#CHECKERR: Invalid value '0' for jobs flag
+rm -r $tmpdir
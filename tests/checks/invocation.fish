@@ -38,3 +38,77 @@ $fish -c 'if status --is-login ; echo login shell ; else ; echo not login shell
 $fish -c 'if status --is-login ; echo login shell ; else ; echo not login shell ; end; if status --is-interactive ; echo interactive ; else ; echo not interactive ; end' -l
 # CHECK: login shell
 # CHECK: not interactive
+
+# The sampling profiler attributes samples to the function and line running.
+set -l tmpdir (mktemp -d)
+$fish --profile-sample $tmpdir/folded --profile-sample-report $tmpdir/report -c '
+function busy
+    for i in (seq 20000)
+        string repeat -n 20 ab | string length -q
+    end
+end
+busy'
+string match -q -r '^-:\d+;busy;-:4 \d+$' <$tmpdir/folded
+and echo sampled busy
+# CHECK: sampled busy
+string match -q -r '^\d+\t\d+\t-> busy$' <$tmpdir/report
+and echo reported busy
+# CHECK: reported busy
+
+# The profiling timer is stopped before an exec, and the samples are written.
+rm $tmpdir/folded
+$fish --profile-sample $tmpdir/folded -c '
+function busy
+    for i in (seq 20000)
+        string repeat -n 20 ab | string length -q
+    end
+end
+busy
+exec sh -c "i=0; while [ \$i -lt 300000 ]; do i=\$((i+1)); done; echo exec ok"'
+# CHECK: exec ok
+string match -q -r '^-:\d+;busy;-:4 \d+$' <$tmpdir/folded
+and echo sampled before exec
+# CHECK: sampled before exec
+rm -r $tmpdir
+
+if not set -q GITHUB_WORKFLOW
+    # An interactive session records the files it autoloads for the next one to preload.
+    set -l tmpdir (mktemp -d)
+    mkdir $tmpdir/functions
+    echo 'function preload_test; echo preload_test $argv; end' >$tmpdir/functions/preload_test.fish
+    set -l cmd "set fish_function_path $tmpdir/functions \$fish_function_path; preload_test"
+    XDG_DATA_HOME=$tmpdir fish_autoload_preload=10 $fish -i -c "$cmd 1"
+    # CHECK: preload_test 1
+    string match -q "$tmpdir/functions/preload_test.fish" <$tmpdir/fish/autoload_preload
+    and echo recorded
+    # CHECK: recorded
+    XDG_DATA_HOME=$tmpdir fish_autoload_preload=10 FISH_AUTOLOAD_PRELOAD_WAIT=1 \
+        $fish -i -d autoload -c "$cmd 2" 2>&1 |
+        string match -e preload_test
+    # CHECK: autoload: Using preloaded '{{.*}}/functions/preload_test.fish'
+    # CHECK: preload_test 2
+    rm -r $tmpdir
+else
+    # Github Action doesn't start this in a terminal, so fake the result as above.
+    echo preload_test 1
+    echo recorded
+    echo "autoload: Using preloaded '/functions/preload_test.fish'"
+    echo preload_test 2
+end
+
+# Structured debug output has one JSON record per line, including the trace.
+$fish --debug-format=json -d exec-fork -c 'set fish_trace 1; command true "a\"b"' 2>&1 |
+    string match -r '"category":"(?:exec-fork|trace)","message":".*"}$'
+# CHECK: "category":"trace","message":"+ true 'a\"b'"}
+# CHECK: "category":"exec-fork","message":"Fork #1, pid {{\d+}}: spawn external command '{{.*}}true' from '<no file>'"}
+# Records queued before an exec are written out first.
+$fish --debug-format=json -d exec-fork -c 'command true; exec true' 2>&1 |
+    string match -r '"category":"exec-fork","message":"Fork #\d+'
+# CHECK: "category":"exec-fork","message":"Fork #1
+# Bytes which are not UTF-8 are escaped, so the output stays valid JSON.
+$fish --debug-format=json -d exec-job-exec \
+    -c 'set -l arg (command printf "a\\377b"); eval "command true $arg"' 2>&1 |
+    string match -r "command true a.*b'"
+# CHECK: command true a\u00ffb'
+$fish --debug-format=yaml -c true
+# CHECKERR: Invalid value 'yaml' for debug-format flag
@@ -22,3 +22,18 @@ end
 
 line-number
 # CHECK: 20
+
+# Line numbers stay right when a loop jumps back to an earlier line.
+for i in 1 2
+    status line-number
+    begin
+        status line-number
+    end
+end
+# CHECK: 28
+# CHECK: 30
+# CHECK: 28
+# CHECK: 30
+
+functions --details --verbose line-number | sed -n 3p
+# CHECK: 19
@@ -111,6 +111,14 @@ not math '2 + 2 4'
 # CHECKERR: math: Error: Too many arguments
 # CHECKERR: '2 + 2 4'
 # CHECKERR:        ^
+not math .
+# CHECKERR: math: Error: Unexpected token
+# CHECKERR: '.'
+# CHECKERR:  ^
+not math 1 + .
+# CHECKERR: math: Error: Unexpected token
+# CHECKERR: '1 + .'
+# CHECKERR:     ^
 not math
 # CHECKERR: math: Expected at least 1 args, got 0
 not math -s 12
@@ -140,3 +148,34 @@ math "42 >= 1337"
 # CHECKERR: math: Error: Logical operations are not supported, use `test` instead
 # CHECKERR: '42 >= 1337'
 # CHECKERR:     ^
+
+# Expressions that only differ in their numbers share a compiled expression.
+math 1 + 2 x 3
+math 4 + 5 x 6
+math '(1 + 2) x 3'
+# CHECK: 7
+# CHECK: 34
+# CHECK: 9
+
+# The radix character doesn't depend on the locale.
+LC_NUMERIC=de_DE.UTF-8 math 1.5 + 1
+# CHECK: 2.5
+
+seq 4 | math --batch '{} ^ 2 + {}'
+# CHECK: 2
+# CHECK: 6
+# CHECK: 12
+# CHECK: 20
+printf '%s\n' 3 ' 1.5 ' nope 0 | math -s2 -b '1 / {}'
+# CHECK: 0.33
+# CHECK: 0.67
+# CHECKERR: math: 'nope' is not a valid number
+# CHECKERR: math: Error: Result is infinite
+# CHECKERR: '1 / {}'
+echo $status
+# CHECK: 1
+not math -b 1 + {}
+# CHECKERR: math: --batch reads its input from stdin
+not math 1 + {}
+# CHECKERR: math: Error: '{}' can only be used with --batch
+# CHECKERR: '1 + {}'
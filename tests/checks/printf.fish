@@ -122,3 +122,9 @@ printf '%d\n' 15.1
 # CHECKERR: 15.1: value not completely converted
 echo $status
 # CHECK: 1
+
+# The format is compiled once and reused for every cycle through the arguments.
+printf '%s=%d\x21\t' a 1 b 2 c; echo
+# CHECK: a=1!	b=2!	c=0!	
+printf '[%b]\c%s\n' 'x\ty' z; echo
+# CHECK: [x	y]
@@ -345,3 +345,36 @@ echo c $c
 # CHECK: a 'afoo barb'
 # CHECK: b
 # CHECK: c
+
+# Reading lines from a pipe must not consume more than the line,
+# even when other commands read from the same pipe in between.
+printf '%s\n' 1 2 3 4 5 6 | begin
+    read -l a
+    read -l b
+    sh -c 'read x; echo $x'
+    read -n 1 -l c
+    read -l d
+    cat
+    echo $a $b $c $d
+end
+# CHECK: 3
+# CHECK: 5
+# CHECK: 6
+# CHECK: 1 2 4
+
+printf 'a\0b\nc\0' | while read -lz x
+    echo "[$x]"
+end
+# CHECK: [a]
+# CHECK: [b
+# CHECK: c]
+
+# Builtins that read stdin get what read left.
+printf '%s\n' 1 'echo sourced' | begin
+    read -l a
+    source
+    read -l b
+    echo $a "[$b]"
+end
+# CHECK: sourced
+# CHECK: 1 []
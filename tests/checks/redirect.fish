@@ -1,4 +1,4 @@
-#RUN: %fish %s
+#RUN: %fish -C 'set -g fish %fish' %s
 
 function outnerr
     command echo out $argv
@@ -113,3 +113,13 @@ echo "/bin/echo pipe 12 <&12 12<&-" | source 12<&0
 #CHECK: pipe 10
 #CHECK: pipe 11
 #CHECK: pipe 12
+
+# Builtin output to an unredirected stdout is written in blocks,
+# but must stay in order with stderr and with other commands.
+$fish -c 'printf "%s\n%d\n" out notanumber; string split , a,b; command echo ext; echo last' 2>&1
+#CHECK: out
+#CHECK: notanumber: expected a numeric value
+#CHECK: a
+#CHECK: b
+#CHECK: ext
+#CHECK: last
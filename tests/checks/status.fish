@@ -80,3 +80,22 @@ if false
 end
 echo $status
 #CHECK: 0
+
+# Performance counters
+status perf reset >/dev/null
+status perf | string match -r '^\S+\s+\d+' | string replace -r '\s+' ' '
+#CHECK: fork 0
+#CHECK: autoload 0
+#CHECK: highlight 0
+#CHECK: history-search 0
+#CHECK: uvar-sync 0
+#CHECK: complete 0
+command true
+complete -C 'status pe' >/dev/null
+status perf reset | string match -r '^(?:fork|complete)\s+\d+' | string replace -r '\s+' ' '
+#CHECK: fork 1
+#CHECK: complete 1
+status perf | string match -r '^complete\s+\d+' | string replace -r '\s+' ' '
+#CHECK: complete 0
+status perf bogus
+#CHECKERR: status: Invalid perf action 'bogus'
@@ -619,3 +619,30 @@ echo $status
 string match -eq asd asd
 echo $status
 # CHECK: 0
+
+# Compiled regexes are cached; make sure the case-insensitivity flag is part of the key.
+for flags in -r -ri -r
+    string match $flags ab AB ab
+end
+# CHECK: ab
+# CHECK: AB
+# CHECK: ab
+# CHECK: ab
+
+# Exact patterns count every match, including from long variables.
+set -l long (seq 40) 3 ""
+string match 3 $long x 3
+# CHECK: 3
+# CHECK: 3
+# CHECK: 3
+string match -n 3 $long
+# CHECK: 1 1
+# CHECK: 1 1
+string match -q 41 $long
+echo $status
+# CHECK: 1
+set long[3] x
+string match 3 $long | count
+# CHECK: 1
+string match -- "" $long | count
+# CHECK: 1
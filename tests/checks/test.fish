@@ -52,3 +52,24 @@ t 5,2
 # CHECKERR: in function 't' with arguments '5,2'
 # CHECKERR: called on line {{\d+}} of file {{.*}}test.fish
 
+
+# Parsed expressions are reused for arguments with the same operators in the same places.
+for args in "1 -lt 2" "2 -lt 1" "-5 -lt +3" "007 -eq 7" "1.5 -gt 1" "999999999999999999 -lt 1000000000000000000"
+    test (string split ' ' -- $args)
+    echo $args $status
+end
+# CHECK: 1 -lt 2 0
+# CHECK: 2 -lt 1 1
+# CHECK: -5 -lt +3 0
+# CHECK: 007 -eq 7 0
+# CHECK: 1.5 -gt 1 0
+# CHECK: 999999999999999999 -lt 1000000000000000000 0
+
+for args in "a = a -o -n b" "-z a -a b = b" "x -a -n y" "! = x"
+    test (string split ' ' -- $args)
+    echo $status
+end
+# CHECK: 0
+# CHECK: 1
+# CHECK: 0
+# CHECK: 1